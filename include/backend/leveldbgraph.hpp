@@ -17,18 +17,43 @@
 #include <iostream>
 #include <type_traits>
 #include <sstream>
+#include <chrono>
 #include <memory>
 #include <cstring>
 #include <iterator>
 #include <vector>
+#include <set>
+#include <map>
+#include <tuple>
 #include <algorithm>
+#include <cstdint>
 
 #include "leveldbgraph_db_utility.inc"
+#include "leveldbgraph_compaction.inc"
+#include "leveldbgraph_prefetch.inc"
+#include "leveldbgraph_planner.inc"
+#include "leveldbgraph_index.inc"
+#include "leveldbgraph_inline.inc"
+#include "leveldbgraph_partition.inc"
+#include "leveldbgraph_label.inc"
+#include "leveldbgraph_deadline.inc"
+#include "leveldbgraph_resultcache.inc"
 
 namespace netalgo
 {
     template<typename NodeType, typename EdgeType, bool isDirected = true>
         class LevelDbGraphIterator;
+    template<typename NodeType, typename EdgeType>
+        class LevelDbGraphBatchCursor;
+    struct AggregateRow;
+    struct QueryProfile;
+    namespace impl
+    {
+        template<typename NodeType, typename EdgeType>
+            class ParallelQuery;
+        template<typename NodeType, typename EdgeType>
+            class ShortestPath;
+    }
 
     namespace
     {
@@ -52,6 +77,106 @@ namespace netalgo
                     leveldb::Options options;
                     const std::string filename_;
                     const std::size_t cacheSize_;
+                    CompactionOptions compactionOptions_;
+                    std::unique_ptr<impl::TombstoneCompactor> compactor;
+                    PrefetchOptions prefetchOptions_;
+                    std::unique_ptr<impl::Prefetcher> prefetcher;
+                    GraphStatistics statistics_;
+                    bool statisticsChanged_ = false;
+                    std::set<std::string> nodeIndexes_, edgeIndexes_;
+                    bool inlineAdjacency_ = false;
+                    std::set<std::string> inlineFields_;
+                    static const std::size_t inlineCacheSize = 1024 * 1024;
+                    impl::TypedMRUMap<std::string, impl::InlineEdges> outInlineCache, inInlineCache;
+                    // empty when the adjacency is not partitioned; the cache is keyed
+                    // by the keys of the partitions
+                    std::string partitionField_;
+                    impl::TypedMRUMap<std::string, impl::InlineEdges> partitionCache;
+                    // the node field labels are taken from, empty when none are kept
+                    std::string labelField_;
+                    // bumped by putKey, deleteKey and destroy, so anything read before
+                    // a write can tell it is stale
+                    std::uint64_t writeVersion_ = 0;
+
+                    bool readKey(const std::string& key, std::string* value);
+                    void loadStatistics();
+                    void saveStatistics();
+                    void loadIndexes();
+                    void saveIndexes(leveldb::WriteBatch* batch);
+                    void loadInline();
+                    void saveInline(leveldb::WriteBatch* batch);
+                    void loadPartition();
+                    void savePartition(leveldb::WriteBatch* batch);
+                    void loadLabels();
+                    void saveLabels(leveldb::WriteBatch* batch);
+                    void eraseLabelEntries(leveldb::WriteBatch* batch);
+                    void updateLabelEntries(const NodeType* oldValue, const NodeType* newValue,
+                                leveldb::WriteBatch* batch);
+                    // entries in [range.begin, range.end), counted up to a limit and
+                    // scaled from their share of [prefix, prefixSuccessor(prefix)) past it
+                    double estimateRange(const impl::IndexRange& range, const std::string& prefix,
+                                std::uint64_t total);
+                    // the adjacency edges are kept in: out at from, and in at to unless
+                    // the graph is undirected
+                    virtual bool directed() const = 0;
+
+                    // The inline adjacency of nodeId, out or in; undirected graphs
+                    // keep every edge as out. The writes do nothing without it.
+                    impl::InlineEdges getInlineEdges(const std::string& nodeId, bool out);
+                    void putInlineEdge(const std::string& nodeId, bool out, const EdgeType& edge,
+                                leveldb::WriteBatch* batch);
+                    void eraseInlineEdge(const std::string& nodeId, bool out, const std::string& edgeId,
+                                leveldb::WriteBatch* batch);
+                    void eraseInlineEdges(const std::string& nodeId, leveldb::WriteBatch* batch);
+
+                    // The stubs of the inline adjacency and of the partitions hold the
+                    // inlined fields and the partition field alike, so either stands in
+                    // for the edge wherever the other would.
+                    std::set<std::string> stubFields() const;
+                    impl::InlineEdges getPartitionEdges(const std::string& nodeId, bool out,
+                                const std::string& label);
+                    void putPartitionEdge(const std::string& nodeId, bool out, const EdgeType& edge,
+                                leveldb::WriteBatch* batch);
+                    void erasePartitionEdge(const std::string& nodeId, bool out, const EdgeType& edge,
+                                leveldb::WriteBatch* batch);
+                    void erasePartitionLists(leveldb::WriteBatch* batch);
+                    // Rewrites the inline adjacency and/or the partitions from the
+                    // adjacency lists, flushing batch as it grows.
+                    void writeStubs(bool inlineLists, bool partitions, const std::set<std::string>& fields,
+                                leveldb::WriteBatch& batch);
+                    // The stubs at nodeId, out or in, of the edges a pattern edge with
+                    // properties can bind: its partition if it reads one, else the
+                    // inline adjacency. false when there are neither.
+                    bool adjacentStubs(const std::string& nodeId, bool out, const Properties& properties,
+                                impl::InlineEdges& stubs);
+
+                    // Every node/edge payload is written and erased through these, so that
+                    // statistics and index entries change in the same batch as the payload.
+                    // pending is a version already written earlier in the same batch. The
+                    // old payload is only read when an index, the labels or the partitions
+                    // need it; otherwise a write counts as new unless listed says the edge
+                    // was in the adjacency of its from already, and analyze() recounts.
+                    void putNodeData(const NodeType& node, const NodeType* pending,
+                                leveldb::WriteBatch* batch);
+                    void eraseNodeData(const std::string& nodeId, leveldb::WriteBatch* batch);
+                    void putEdgeData(const EdgeType& edge, const EdgeType* pending,
+                                leveldb::WriteBatch* batch, bool listed = false);
+                    void eraseEdgeData(const EdgeType& edge, leveldb::WriteBatch* batch);
+                    template<typename T>
+                        void updateIndexEntries(const char* kind, const std::set<std::string>& fields,
+                                    const T* oldValue, const T* newValue, leveldb::WriteBatch* batch);
+                    template<typename T>
+                        void createIndex(const char* kind, const char* dataSuffix,
+                                    std::set<std::string>& fields, const std::string& field);
+                    void dropIndex(const char* kind, std::set<std::string>& fields,
+                                const std::string& field);
+
+                    void putKey(const std::string& key, const leveldb::Slice& value,
+                                leveldb::WriteBatch* batch = nullptr);
+                    void deleteKey(const std::string& key, leveldb::WriteBatch* batch = nullptr);
+                    // writes a batch filled by putKey and deleteKey, with the statistics
+                    // when it changed them
+                    leveldb::Status writeBatch(leveldb::WriteBatch* batch);
                 public:
                     explicit LevelDbGraphBase(const std::string& filename);
                     explicit LevelDbGraphBase(const std::string& filename, std::size_t cacheSizeInMB);
@@ -67,6 +192,89 @@ namespace netalgo
                     typedef typename InterfaceType::EdgeIdType EdgeIdType;
 
                     virtual void destroy() override;
+
+                    void setCompactionOptions(const CompactionOptions& compactionOptions);
+                    CompactionStats getCompactionStats() const;
+                    void waitForCompactions();
+
+                    // off until prefetchOptions.threads is set
+                    void setPrefetchOptions(const PrefetchOptions& prefetchOptions);
+                    PrefetchStats getPrefetchStats() const;
+                    void waitForPrefetches();
+
+                    // kept up to date by every set/remove and saved on close;
+                    // analyze() recounts everything with a full scan
+                    GraphStatistics getStatistics() const;
+                    void analyze();
+
+                    // Secondary indexes on scalar/string fields. Creating one indexes the
+                    // existing data; the planner uses them for =, < and > on that field.
+                    void createNodeIndex(const std::string& field);
+                    void createEdgeIndex(const std::string& field);
+                    void dropNodeIndex(const std::string& field);
+                    void dropEdgeIndex(const std::string& field);
+                    bool hasNodeIndex(const std::string& field) const;
+                    bool hasEdgeIndex(const std::string& field) const;
+                    // entries an index scan for prop would visit, -1 if the field is not indexed
+                    double estimateIndexScan(bool isNode, const Property& prop);
+
+                    // Keeps the ids of the nodes of every label, the values of a string
+                    // field of the node, so that (a:Label) scans those nodes alone and
+                    // checks a bound node with one read. Setting another field rewrites
+                    // it all.
+                    void setNodeLabelField(const std::string& field);
+                    void dropNodeLabels();
+                    bool hasNodeLabels() const
+                    {
+                        return !labelField_.empty();
+                    }
+                    // nodes carrying label, -1 if no labels are kept
+                    double estimateLabelScan(const std::string& label);
+
+                    // Keeps the endpoints of every edge, and the given fields of it, in
+                    // the adjacency of its nodes, so traversals and predicates on those
+                    // fields do not read the edge. Setting other fields rewrites it all.
+                    void setInlineEdgeFields(const std::set<std::string>& fields);
+                    void dropInlineAdjacency();
+                    bool hasInlineAdjacency() const
+                    {
+                        return inlineAdjacency_;
+                    }
+                    // true when the inline adjacency answers every one of properties
+                    bool inlines(const Properties& properties) const
+                    {
+                        return inlineAdjacency_ && impl::inlinedProperties(properties, inlineFields_);
+                    }
+                    bool inlinesField(const std::string& field) const
+                    {
+                        return inlineAdjacency_ && (impl::isEndpointField(field) ||
+                                    inlineFields_.find(field) != inlineFields_.end() || field == partitionField_);
+                    }
+
+                    // Splits the adjacency of every node by the value of one scalar or
+                    // string field of its edges, so that a step asking for field = value
+                    // reads the edges with that value alone. Setting another field
+                    // rewrites it all.
+                    void setEdgePartitionField(const std::string& field);
+                    void dropEdgePartition();
+                    bool hasEdgePartition() const
+                    {
+                        return !partitionField_.empty();
+                    }
+                    // the label of the partition an edge of a pattern with properties
+                    // reads, false when it reads the whole adjacency
+                    bool partitions(const Properties& properties, std::string& label) const
+                    {
+                        return impl::partitionLabel<EdgeType>(properties, partitionField_, label);
+                    }
+                    // true when the stubs read for an edge of a pattern with properties
+                    // answer every one of them
+                    bool stubsAnswer(const Properties& properties) const
+                    {
+                        std::string label;
+                        return (inlineAdjacency_ || partitions(properties, label)) &&
+                            impl::inlinedProperties(properties, stubFields());
+                    }
             };
 
         template<typename NodeType, typename EdgeType>
@@ -76,7 +284,8 @@ namespace netalgo
 
         template<typename NodeType, typename EdgeType>
             LevelDbGraphBase<NodeType, EdgeType>::LevelDbGraphBase(const std::string& filename,
-                        std::size_t cacheSizeInMB): filename_(filename), cacheSize_(cacheSizeInMB)
+                        std::size_t cacheSizeInMB): filename_(filename), cacheSize_(cacheSizeInMB),
+            outInlineCache(inlineCacheSize), inInlineCache(inlineCacheSize), partitionCache(inlineCacheSize)
         {
             options.create_if_missing = true;
             options.block_cache = leveldb::NewLRUCache(cacheSizeInMB * 1024 * 1024);
@@ -88,11 +297,21 @@ namespace netalgo
                 std::cerr << status.ToString() << std::endl;
                 std::terminate();
             }
+            compactor.reset(new impl::TombstoneCompactor(db, compactionOptions_));
+            prefetcher.reset(new impl::Prefetcher(db, prefetchOptions_));
+            loadStatistics();
+            loadIndexes();
+            loadInline();
+            loadPartition();
+            loadLabels();
         }
 
         template<typename NodeType, typename EdgeType>
             LevelDbGraphBase<NodeType, EdgeType>::~LevelDbGraphBase()
             {
+                saveStatistics();
+                prefetcher.reset();
+                compactor.reset();
                 delete db;
                 delete options.block_cache;
             }
@@ -100,6 +319,8 @@ namespace netalgo
         template<typename NodeType, typename EdgeType>
             void LevelDbGraphBase<NodeType, EdgeType>::destroy()
             {
+                prefetcher.reset();
+                compactor.reset();
                 delete db;
                 delete options.block_cache;
                 leveldb::DestroyDB(filename_, leveldb::Options());
@@ -113,7 +334,828 @@ namespace netalgo
                     std::cerr << status.ToString() << std::endl;
                     std::terminate();
                 }
+                compactor.reset(new impl::TombstoneCompactor(db, compactionOptions_));
+                prefetcher.reset(new impl::Prefetcher(db, prefetchOptions_));
+                statistics_ = GraphStatistics();
+                statisticsChanged_ = false;
+                nodeIndexes_.clear();
+                edgeIndexes_.clear();
+                inlineAdjacency_ = false;
+                inlineFields_.clear();
+                outInlineCache.clear();
+                inInlineCache.clear();
+                partitionField_.clear();
+                partitionCache.clear();
+                labelField_.clear();
+                ++writeVersion_;
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::setCompactionOptions(
+                        const CompactionOptions& compactionOptions)
+            {
+                compactionOptions_ = compactionOptions;
+                compactor.reset();
+                compactor.reset(new impl::TombstoneCompactor(db, compactionOptions_));
+            }
+
+        template<typename NodeType, typename EdgeType>
+            CompactionStats LevelDbGraphBase<NodeType, EdgeType>::getCompactionStats() const
+            {
+                return compactor->getStats();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::waitForCompactions()
+            {
+                compactor->waitForIdle();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::setPrefetchOptions(
+                        const PrefetchOptions& prefetchOptions)
+            {
+                prefetchOptions_ = prefetchOptions;
+                prefetcher.reset();
+                prefetcher.reset(new impl::Prefetcher(db, prefetchOptions_));
+            }
+
+        template<typename NodeType, typename EdgeType>
+            PrefetchStats LevelDbGraphBase<NodeType, EdgeType>::getPrefetchStats() const
+            {
+                return prefetcher->getStats();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::waitForPrefetches()
+            {
+                prefetcher->waitForIdle();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            GraphStatistics LevelDbGraphBase<NodeType, EdgeType>::getStatistics() const
+            {
+                return statistics_;
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::analyze()
+            {
+                GraphStatistics result;
+                std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+                for (it->SeekToFirst(); it->Valid(); it->Next())
+                {
+                    if (isDataKey(it->key(), nodeDataIdSuffix))
+                        ++result.nodeCount;
+                    else if (isDataKey(it->key(), edgeDataIdSuffix))
+                        ++result.edgeCount;
+                }
+                statistics_ = result;
+                saveStatistics();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            bool LevelDbGraphBase<NodeType, EdgeType>::readKey(const std::string& key, std::string* value)
+            {
+                leveldb::Status status = db->Get(leveldb::ReadOptions(), key, value);
+                assert(status.ok() || status.IsNotFound());
+                return status.ok();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::loadStatistics()
+            {
+                std::string raw;
+                leveldb::Status status = db->Get(leveldb::ReadOptions(), statisticsKey, &raw);
+                if (status.ok())
+                {
+                    // written with every batch changing them, so they survive a crash
+                    auto counts = strToDataByCereal< std::pair<std::uint64_t, std::uint64_t> >(raw);
+                    statistics_.nodeCount = counts.first;
+                    statistics_.edgeCount = counts.second;
+                    return;
+                }
+                std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+                it->SeekToFirst();
+                if (it->Valid())
+                    analyze();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::saveStatistics()
+            {
+                stringStreamSlice slice = dataToSliceByCereal(
+                            std::make_pair(statistics_.nodeCount, statistics_.edgeCount));
+                leveldb::Status status = db->Put(leveldb::WriteOptions(), statisticsKey, slice.getSlice());
+                assert(status.ok());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::loadIndexes()
+            {
+                std::string raw;
+                if (readKey(indexesKey, &raw))
+                    std::tie(nodeIndexes_, edgeIndexes_) =
+                        strToDataByCereal< std::pair< std::set<std::string>, std::set<std::string> > >(raw);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::saveIndexes(leveldb::WriteBatch* batch)
+            {
+                stringStreamSlice slice = dataToSliceByCereal(std::make_pair(nodeIndexes_, edgeIndexes_));
+                batch->Put(indexesKey, slice.getSlice());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::loadInline()
+            {
+                std::string raw;
+                if (readKey(inlineKey, &raw))
+                    std::tie(inlineAdjacency_, inlineFields_) =
+                        strToDataByCereal< std::pair< bool, std::set<std::string> > >(raw);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::saveInline(leveldb::WriteBatch* batch)
+            {
+                stringStreamSlice slice = dataToSliceByCereal(std::make_pair(inlineAdjacency_, inlineFields_));
+                batch->Put(inlineKey, slice.getSlice());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            impl::InlineEdges LevelDbGraphBase<NodeType, EdgeType>::getInlineEdges(const std::string& nodeId,
+                        bool out)
+            {
+                auto& cache = out ? outInlineCache : inInlineCache;
+                auto cached = cache.find(nodeId);
+                if (cached != cache.end())
+                    return cached->second;
+                std::string raw;
+                if (readKey(addSuffix(nodeId, out ? outInlineSuffix : inInlineSuffix), &raw))
+                    return strToDataByCereal<impl::InlineEdges>(raw);
+                return impl::InlineEdges();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::putInlineEdge(const std::string& nodeId, bool out,
+                        const EdgeType& edge, leveldb::WriteBatch* batch)
+            {
+                if (!inlineAdjacency_)
+                    return;
+                impl::InlineEdges edges = getInlineEdges(nodeId, out);
+                edges[edge.id()] = impl::encodeStub(edge, stubFields());
+                stringStreamSlice slice = dataToSliceByCereal(edges);
+                putKey(addSuffix(nodeId, out ? outInlineSuffix : inInlineSuffix), slice.getSlice(), batch);
+                (out ? outInlineCache : inInlineCache)[nodeId] = std::move(edges);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::eraseInlineEdge(const std::string& nodeId, bool out,
+                        const std::string& edgeId, leveldb::WriteBatch* batch)
+            {
+                if (!inlineAdjacency_)
+                    return;
+                impl::InlineEdges edges = getInlineEdges(nodeId, out);
+                edges.erase(edgeId);
+                stringStreamSlice slice = dataToSliceByCereal(edges);
+                putKey(addSuffix(nodeId, out ? outInlineSuffix : inInlineSuffix), slice.getSlice(), batch);
+                (out ? outInlineCache : inInlineCache)[nodeId] = std::move(edges);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::eraseInlineEdges(const std::string& nodeId,
+                        leveldb::WriteBatch* batch)
+            {
+                if (!inlineAdjacency_)
+                    return;
+                deleteKey(addSuffix(nodeId, outInlineSuffix), batch);
+                deleteKey(addSuffix(nodeId, inInlineSuffix), batch);
+                outInlineCache.erase(nodeId);
+                inInlineCache.erase(nodeId);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::setInlineEdgeFields(const std::set<std::string>& fields)
+            {
+                impl::checkInlineFields<EdgeType>(fields);
+                if (inlineAdjacency_ && fields == inlineFields_)
+                    return;
+                std::set<std::string> stubbed(fields);
+                if (!partitionField_.empty())
+                    stubbed.insert(partitionField_);
+                leveldb::WriteBatch batch;
+                writeStubs(true, !partitionField_.empty(), stubbed, batch);
+                outInlineCache.clear();
+                inInlineCache.clear();
+                partitionCache.clear();
+                // used once it is complete
+                inlineAdjacency_ = true;
+                inlineFields_ = fields;
+                saveInline(&batch);
+                leveldb::Status status = writeBatch(&batch);
+                assert(status.ok());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::dropInlineAdjacency()
+            {
+                if (!inlineAdjacency_)
+                    return;
+                inlineAdjacency_ = false;
+                inlineFields_.clear();
+                outInlineCache.clear();
+                inInlineCache.clear();
+                leveldb::WriteBatch batch;
+                saveInline(&batch);
+                std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+                for (it->SeekToFirst(); it->Valid(); it->Next())
+                    if (endsWith(it->key(), outInlineSuffix) || endsWith(it->key(), inInlineSuffix))
+                        deleteKey(it->key().ToString(), &batch);
+                leveldb::Status status = writeBatch(&batch);
+                assert(status.ok());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::loadPartition()
+            {
+                std::string raw;
+                if (readKey(partitionKey, &raw))
+                    partitionField_ = strToDataByCereal<std::string>(raw);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::savePartition(leveldb::WriteBatch* batch)
+            {
+                stringStreamSlice slice = dataToSliceByCereal(partitionField_);
+                batch->Put(partitionKey, slice.getSlice());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::loadLabels()
+            {
+                std::string raw;
+                if (readKey(labelsKey, &raw))
+                    labelField_ = strToDataByCereal<std::string>(raw);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::saveLabels(leveldb::WriteBatch* batch)
+            {
+                stringStreamSlice slice = dataToSliceByCereal(labelField_);
+                batch->Put(labelsKey, slice.getSlice());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::eraseLabelEntries(leveldb::WriteBatch* batch)
+            {
+                const std::string prefix = labelKeyPrefix;
+                std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+                for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next())
+                    deleteKey(it->key().ToString(), batch);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::updateLabelEntries(const NodeType* oldValue,
+                        const NodeType* newValue, leveldb::WriteBatch* batch)
+            {
+                std::set<std::string> oldLabels, newLabels;
+                if (oldValue)
+                    oldLabels = impl::nodeLabels(*oldValue, labelField_);
+                if (newValue)
+                    newLabels = impl::nodeLabels(*newValue, labelField_);
+                for (const auto& label : oldLabels)
+                    if (newLabels.find(label) == newLabels.end())
+                        deleteKey(impl::labelKey(label, oldValue->id()), batch);
+                for (const auto& label : newLabels)
+                    if (oldLabels.find(label) == oldLabels.end())
+                        putKey(impl::labelKey(label, newValue->id()), newValue->id(), batch);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::setNodeLabelField(const std::string& field)
+            {
+                impl::checkLabelField<NodeType>(field);
+                if (field == labelField_)
+                    return;
+                leveldb::WriteBatch batch;
+                eraseLabelEntries(&batch);
+                leveldb::Status status = writeBatch(&batch);
+                assert(status.ok());
+                batch.Clear();
+                labelField_ = field;
+                const std::size_t batchSize = 4096;
+                std::size_t batched = 0;
+                std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+                for (it->SeekToFirst(); it->Valid(); it->Next())
+                {
+                    if (!endsWith(it->key(), nodeDataIdSuffix))
+                        continue;
+                    NodeType node = strToDataByProtobuf<NodeType>(it->value().ToString());
+                    updateLabelEntries(nullptr, &node, &batch);
+                    if (++batched == batchSize)
+                    {
+                        status = writeBatch(&batch);
+                        assert(status.ok());
+                        batch.Clear();
+                        batched = 0;
+                    }
+                }
+                // the labels are only used once they are complete
+                saveLabels(&batch);
+                status = writeBatch(&batch);
+                assert(status.ok());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::dropNodeLabels()
+            {
+                if (labelField_.empty())
+                    return;
+                labelField_.clear();
+                leveldb::WriteBatch batch;
+                saveLabels(&batch);
+                eraseLabelEntries(&batch);
+                leveldb::Status status = writeBatch(&batch);
+                assert(status.ok());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            std::set<std::string> LevelDbGraphBase<NodeType, EdgeType>::stubFields() const
+            {
+                std::set<std::string> fields(inlineFields_);
+                if (!partitionField_.empty())
+                    fields.insert(partitionField_);
+                return fields;
+            }
+
+        template<typename NodeType, typename EdgeType>
+            impl::InlineEdges LevelDbGraphBase<NodeType, EdgeType>::getPartitionEdges(const std::string& nodeId,
+                        bool out, const std::string& label)
+            {
+                std::string key = impl::partitionListKey(nodeId, out, label), raw;
+                auto cached = partitionCache.find(key);
+                if (cached != partitionCache.end())
+                    return cached->second;
+                if (readKey(key, &raw))
+                    return strToDataByCereal<impl::InlineEdges>(raw);
+                return impl::InlineEdges();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::putPartitionEdge(const std::string& nodeId, bool out,
+                        const EdgeType& edge, leveldb::WriteBatch* batch)
+            {
+                std::string label = impl::partitionLabel(edge, partitionField_);
+                impl::InlineEdges edges = getPartitionEdges(nodeId, out, label);
+                edges[edge.id()] = impl::encodeStub(edge, stubFields());
+                stringStreamSlice slice = dataToSliceByCereal(edges);
+                std::string key = impl::partitionListKey(nodeId, out, label);
+                putKey(key, slice.getSlice(), batch);
+                partitionCache[key] = std::move(edges);
+            }
+
+        // partitions left empty are deleted, so that those of a removed node go
+        // with its last edge
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::erasePartitionEdge(const std::string& nodeId, bool out,
+                        const EdgeType& edge, leveldb::WriteBatch* batch)
+            {
+                std::string label = impl::partitionLabel(edge, partitionField_);
+                impl::InlineEdges edges = getPartitionEdges(nodeId, out, label);
+                if (edges.erase(edge.id()) == 0)
+                    return;
+                std::string key = impl::partitionListKey(nodeId, out, label);
+                if (edges.empty())
+                    deleteKey(key, batch);
+                else
+                {
+                    stringStreamSlice slice = dataToSliceByCereal(edges);
+                    putKey(key, slice.getSlice(), batch);
+                }
+                partitionCache[key] = std::move(edges);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::erasePartitionLists(leveldb::WriteBatch* batch)
+            {
+                std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+                for (it->SeekToFirst(); it->Valid(); it->Next())
+                    if (impl::isPartitionListKey(it->key()))
+                        deleteKey(it->key().ToString(), batch);
+                partitionCache.clear();
+            }
+
+        // Every adjacency list gets an inline twin holding the stubs of its edges
+        // and/or is split by the partition field into one list per label.
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::writeStubs(bool inlineLists, bool partitions,
+                        const std::set<std::string>& fields, leveldb::WriteBatch& batch)
+            {
+                const std::size_t batchSize = 4096;
+                std::size_t batched = 0;
+                std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+                for (it->SeekToFirst(); it->Valid(); it->Next())
+                {
+                    leveldb::Slice key = it->key();
+                    bool out;
+                    std::size_t suffixSize;
+                    if (endsWith(key, outEdgeSuffix))
+                    {
+                        out = true;
+                        suffixSize = std::strlen(outEdgeSuffix);
+                    } else if (endsWith(key, inEdgeSuffix))
+                    {
+                        out = false;
+                        suffixSize = std::strlen(inEdgeSuffix);
+                    } else
+                        continue;
+                    std::string nodeId(key.data(), key.size() - suffixSize), raw;
+                    impl::InlineEdges edges;
+                    std::map<std::string, impl::InlineEdges> labelled;
+                    for (const std::string& edgeId :
+                                strToDataByCereal< std::set<std::string> >(it->value().ToString()))
+                        if (readKey(addSuffix(edgeId, edgeDataIdSuffix), &raw))
+                        {
+                            EdgeType edge = strToDataByProtobuf<EdgeType>(raw);
+                            std::string stub = impl::encodeStub(edge, fields);
+                            if (partitions)
+                                labelled[impl::partitionLabel(edge, partitionField_)][edgeId] = stub;
+                            edges[edgeId] = std::move(stub);
+                        }
+                    if (inlineLists)
+                    {
+                        stringStreamSlice slice = dataToSliceByCereal(edges);
+                        putKey(addSuffix(nodeId, out ? outInlineSuffix : inInlineSuffix), slice.getSlice(), &batch);
+                    }
+                    for (const auto& partition : labelled)
+                    {
+                        stringStreamSlice slice = dataToSliceByCereal(partition.second);
+                        putKey(impl::partitionListKey(nodeId, out, partition.first), slice.getSlice(), &batch);
+                    }
+                    if (++batched == batchSize)
+                    {
+                        leveldb::Status status = writeBatch(&batch);
+                        assert(status.ok());
+                        batch.Clear();
+                        batched = 0;
+                    }
+                }
+            }
+
+        template<typename NodeType, typename EdgeType>
+            bool LevelDbGraphBase<NodeType, EdgeType>::adjacentStubs(const std::string& nodeId, bool out,
+                        const Properties& properties, impl::InlineEdges& stubs)
+            {
+                std::string label;
+                if (partitions(properties, label))
+                    stubs = getPartitionEdges(nodeId, out, label);
+                else if (inlineAdjacency_)
+                    stubs = getInlineEdges(nodeId, out);
+                else
+                    return false;
+                return true;
+            }
+
+        // The partition field goes into the stubs of the inline adjacency too,
+        // which is rewritten with them.
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::setEdgePartitionField(const std::string& field)
+            {
+                impl::checkPartitionField<EdgeType>(field);
+                if (field == partitionField_)
+                    return;
+                leveldb::WriteBatch batch;
+                erasePartitionLists(&batch);
+                leveldb::Status status = writeBatch(&batch);
+                assert(status.ok());
+                batch.Clear();
+                partitionField_ = field;
+                writeStubs(inlineAdjacency_, true, stubFields(), batch);
+                outInlineCache.clear();
+                inInlineCache.clear();
+                partitionCache.clear();
+                savePartition(&batch);
+                status = writeBatch(&batch);
+                assert(status.ok());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::dropEdgePartition()
+            {
+                if (partitionField_.empty())
+                    return;
+                partitionField_.clear();
+                leveldb::WriteBatch batch;
+                savePartition(&batch);
+                erasePartitionLists(&batch);
+                leveldb::Status status = writeBatch(&batch);
+                assert(status.ok());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            template<typename T>
+            void LevelDbGraphBase<NodeType, EdgeType>::updateIndexEntries(const char* kind,
+                        const std::set<std::string>& fields,
+                        const T* oldValue, const T* newValue, leveldb::WriteBatch* batch)
+            {
+                for (const auto& field : fields)
+                {
+                    std::string oldKey, newKey;
+                    if (oldValue)
+                        oldKey = impl::indexKey(kind, field, *oldValue, oldValue->id());
+                    if (newValue)
+                        newKey = impl::indexKey(kind, field, *newValue, newValue->id());
+                    if (oldKey == newKey)
+                        continue;
+                    if (oldValue)
+                        deleteKey(oldKey, batch);
+                    if (newValue)
+                        putKey(newKey, newValue->id(), batch);
+                }
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::putNodeData(const NodeType& node,
+                        const NodeType* pending, leveldb::WriteBatch* batch)
+            {
+                checkDataId(node.id());
+                std::string key = addSuffix(node.id(), nodeDataIdSuffix), raw;
+                bool needsOld = !nodeIndexes_.empty() || !labelField_.empty();
+                bool existed = pending != nullptr || readKey(key, &raw);
+                if (!existed)
+                {
+                    ++statistics_.nodeCount;
+                    statisticsChanged_ = true;
+                }
+                if (needsOld)
+                {
+                    NodeType old;
+                    if (pending == nullptr && existed)
+                    {
+                        old = strToDataByProtobuf<NodeType>(raw);
+                        pending = &old;
+                    }
+                    updateIndexEntries(impl::nodeIndexKind, nodeIndexes_, pending, &node, batch);
+                    updateLabelEntries(pending, &node, batch);
+                }
+                stringSlice ssslice = dataToSliceByProtobuf(node);
+                putKey(key, ssslice.getSlice(), batch);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::eraseNodeData(const std::string& nodeId,
+                        leveldb::WriteBatch* batch)
+            {
+                std::string key = addSuffix(nodeId, nodeDataIdSuffix), raw;
+                if (readKey(key, &raw))
+                {
+                    if (statistics_.nodeCount > 0)
+                        --statistics_.nodeCount;
+                    statisticsChanged_ = true;
+                    if (!nodeIndexes_.empty() || !labelField_.empty())
+                    {
+                        NodeType old = strToDataByProtobuf<NodeType>(raw);
+                        updateIndexEntries<NodeType>(impl::nodeIndexKind, nodeIndexes_, &old, nullptr, batch);
+                        updateLabelEntries(&old, nullptr, batch);
+                    }
+                }
+                deleteKey(key, batch);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::putEdgeData(const EdgeType& edge,
+                        const EdgeType* pending, leveldb::WriteBatch* batch, bool listed)
+            {
+                checkDataId(edge.id());
+                std::string key = addSuffix(edge.id(), edgeDataIdSuffix), raw;
+                bool needsOld = !edgeIndexes_.empty() || !partitionField_.empty();
+                // an edge in the out list of its from exists, the store is only read
+                // when the old payload is needed or the edge may have had another from
+                bool existed = pending != nullptr || (listed && !needsOld) || readKey(key, &raw);
+                if (!existed)
+                {
+                    ++statistics_.edgeCount;
+                    statisticsChanged_ = true;
+                }
+                if (needsOld)
+                {
+                    EdgeType old;
+                    if (pending == nullptr && existed)
+                    {
+                        old = strToDataByProtobuf<EdgeType>(raw);
+                        pending = &old;
+                    }
+                    updateIndexEntries(impl::edgeIndexKind, edgeIndexes_, pending, &edge, batch);
+                    if (!partitionField_.empty())
+                    {
+                        // an edge given another label or other endpoints leaves its partitions
+                        if (pending != nullptr && (pending->from() != edge.from() || pending->to() != edge.to() ||
+                                        impl::partitionLabel(*pending, partitionField_) !=
+                                        impl::partitionLabel(edge, partitionField_)))
+                        {
+                            erasePartitionEdge(pending->from(), true, *pending, batch);
+                            erasePartitionEdge(pending->to(), !directed(), *pending, batch);
+                        }
+                        putPartitionEdge(edge.from(), true, edge, batch);
+                        putPartitionEdge(edge.to(), !directed(), edge, batch);
+                    }
+                }
+                stringSlice resultproto = dataToSliceByProtobuf(edge);
+                putKey(key, resultproto.getSlice(), batch);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::eraseEdgeData(const EdgeType& edge,
+                        leveldb::WriteBatch* batch)
+            {
+                if (statistics_.edgeCount > 0)
+                    --statistics_.edgeCount;
+                statisticsChanged_ = true;
+                updateIndexEntries<EdgeType>(impl::edgeIndexKind, edgeIndexes_, &edge, nullptr, batch);
+                if (!partitionField_.empty())
+                {
+                    erasePartitionEdge(edge.from(), true, edge, batch);
+                    erasePartitionEdge(edge.to(), !directed(), edge, batch);
+                }
+                deleteKey(addSuffix(edge.id(), edgeDataIdSuffix), batch);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            template<typename T>
+            void LevelDbGraphBase<NodeType, EdgeType>::createIndex(const char* kind,
+                        const char* dataSuffix, std::set<std::string>& fields, const std::string& field)
+            {
+                impl::indexedField(T::descriptor(), field);
+                if (fields.find(field) != fields.end())
+                    return;
+                const std::size_t batchSize = 4096;
+                leveldb::WriteBatch batch;
+                std::size_t batched = 0;
+                std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+                for (it->SeekToFirst(); it->Valid(); it->Next())
+                {
+                    if (!isDataKey(it->key(), dataSuffix))
+                        continue;
+                    T value = strToDataByProtobuf<T>(it->value().ToString());
+                    std::string id(it->key().data(), it->key().size() - std::strlen(dataSuffix));
+                    putKey(impl::indexKey(kind, field, value, id), id, &batch);
+                    if (++batched == batchSize)
+                    {
+                        leveldb::Status status = writeBatch(&batch);
+                        assert(status.ok());
+                        batch.Clear();
+                        batched = 0;
+                    }
+                }
+                // the index is only used once it is complete
+                fields.insert(field);
+                saveIndexes(&batch);
+                leveldb::Status status = writeBatch(&batch);
+                assert(status.ok());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::dropIndex(const char* kind,
+                        std::set<std::string>& fields, const std::string& field)
+            {
+                if (fields.erase(field) == 0)
+                    return;
+                leveldb::WriteBatch batch;
+                saveIndexes(&batch);
+                std::string prefix = impl::indexPrefix(kind, field);
+                std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+                for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next())
+                    deleteKey(it->key().ToString(), &batch);
+                leveldb::Status status = writeBatch(&batch);
+                assert(status.ok());
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::createNodeIndex(const std::string& field)
+            {
+                createIndex<NodeType>(impl::nodeIndexKind, nodeDataIdSuffix, nodeIndexes_, field);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::createEdgeIndex(const std::string& field)
+            {
+                createIndex<EdgeType>(impl::edgeIndexKind, edgeDataIdSuffix, edgeIndexes_, field);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::dropNodeIndex(const std::string& field)
+            {
+                dropIndex(impl::nodeIndexKind, nodeIndexes_, field);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::dropEdgeIndex(const std::string& field)
+            {
+                dropIndex(impl::edgeIndexKind, edgeIndexes_, field);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            bool LevelDbGraphBase<NodeType, EdgeType>::hasNodeIndex(const std::string& field) const
+            {
+                return nodeIndexes_.find(field) != nodeIndexes_.end();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            bool LevelDbGraphBase<NodeType, EdgeType>::hasEdgeIndex(const std::string& field) const
+            {
+                return edgeIndexes_.find(field) != edgeIndexes_.end();
+            }
+
+        template<typename NodeType, typename EdgeType>
+            double LevelDbGraphBase<NodeType, EdgeType>::estimateIndexScan(bool isNode, const Property& prop)
+            {
+                if (!(isNode ? hasNodeIndex(prop.name) : hasEdgeIndex(prop.name)))
+                    return -1;
+                const char* kind = isNode ? impl::nodeIndexKind : impl::edgeIndexKind;
+                impl::IndexRange range = isNode ? impl::indexRange<NodeType>(kind, prop) :
+                    impl::indexRange<EdgeType>(kind, prop);
+                return estimateRange(range, impl::indexPrefix(kind, prop.name),
+                            isNode ? statistics_.nodeCount : statistics_.edgeCount);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            double LevelDbGraphBase<NodeType, EdgeType>::estimateLabelScan(const std::string& label)
+            {
+                if (labelField_.empty())
+                    return -1;
+                return estimateRange(impl::labelRange(label), labelKeyPrefix, statistics_.nodeCount);
+            }
+
+        // selective ranges are counted, larger ones are scaled from their share of the prefix
+        template<typename NodeType, typename EdgeType>
+            double LevelDbGraphBase<NodeType, EdgeType>::estimateRange(const impl::IndexRange& range,
+                        const std::string& prefix, std::uint64_t total)
+            {
+                const std::size_t probeLimit = 1000;
+                std::size_t count = 0;
+                std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+                for (it->Seek(range.begin);
+                            it->Valid() && it->key().compare(range.end) < 0 && count < probeLimit;
+                            it->Next())
+                    ++count;
+                if (count < probeLimit)
+                    return count;
+
+                std::string prefixEnd = prefixSuccessor(prefix);
+                leveldb::Range ranges[2] = { leveldb::Range(range.begin, range.end),
+                    leveldb::Range(prefix, prefixEnd) };
+                std::uint64_t sizes[2];
+                db->GetApproximateSizes(ranges, 2, sizes);
+                if (sizes[1] == 0) // everything is still in the memtable
+                    return std::max<double>(count, total / 3.0);
+                return std::max<double>(count, static_cast<double>(total) * sizes[0] / sizes[1]);
+            }
+
+        template<typename NodeType, typename EdgeType>
+            leveldb::Status LevelDbGraphBase<NodeType, EdgeType>::writeBatch(leveldb::WriteBatch* batch)
+            {
+                if (statisticsChanged_)
+                {
+                    stringStreamSlice slice = dataToSliceByCereal(
+                                std::make_pair(statistics_.nodeCount, statistics_.edgeCount));
+                    batch->Put(statisticsKey, slice.getSlice());
+                    statisticsChanged_ = false;
+                }
+                leveldb::Status status = db->Write(leveldb::WriteOptions(), batch);
+                compactor->commit();
+                return status;
+            }
+
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::putKey(const std::string& key,
+                        const leveldb::Slice& value, leveldb::WriteBatch* batch)
+            {
+                ++writeVersion_;
+                compactor->trackWrite(key, value.size());
+                if (batch == nullptr)
+                {
+                    leveldb::Status status = db->Put(leveldb::WriteOptions(), key, value);
+                    assert(status.ok());
+                    compactor->commit();
+                }
+                else
+                    batch->Put(key, value);
+            }
 
+        template<typename NodeType, typename EdgeType>
+            void LevelDbGraphBase<NodeType, EdgeType>::deleteKey(const std::string& key,
+                        leveldb::WriteBatch* batch)
+            {
+                ++writeVersion_;
+                compactor->trackDelete(key);
+                if (batch == nullptr)
+                {
+                    leveldb::Status status = db->Delete(leveldb::WriteOptions(), key);
+                    assert(status.ok() || status.IsNotFound());
+                    compactor->commit();
+                }
+                else
+                    batch->Delete(key);
             }
     }
 
@@ -141,12 +1183,48 @@ namespace netalgo
             typedef typename InterfaceType::NodeIdType NodeIdType;
             typedef typename InterfaceType::EdgeIdType EdgeIdType;
 
+            typedef LevelDbGraphBatchCursor<NodeType, EdgeType> BatchCursorType;
+
             friend class LevelDbGraphIterator<NodeType, EdgeType, true>;
+            friend class LevelDbGraphBatchCursor<NodeType, EdgeType>;
+            friend class impl::ParallelQuery<NodeType, EdgeType>;
+            friend class impl::ShortestPath<NodeType, EdgeType>;
 
             virtual ResultType
                 query(const GraphSqlSentence&);
             virtual ResultType
                 end();
+            // stops at the deadline of control or when its token is cancelled; the
+            // iterator then equals end() and its status() says why
+            ResultType
+                query(const GraphSqlSentence&, const QueryControl& control);
+            // runs the query on up to parallelism threads, each expanding part of
+            // the anchor scan; ordered keeps the order of query(q)
+            ResultType
+                query(const GraphSqlSentence&, std::size_t parallelism, bool ordered = false,
+                            const QueryControl& control = QueryControl());
+            // passes every result to sink until it returns false, the limit is
+            // reached or the query runs out; returns how many results sink got
+            template<typename Sink>
+                std::size_t execute(const GraphSqlSentence&, Sink sink, std::size_t parallelism = 1);
+            // same results as query(), produced batchSize anchors at a time
+            BatchCursorType
+                queryBatches(const GraphSqlSentence&, std::size_t batchSize = 1024,
+                            const QueryControl& control = QueryControl());
+            // runs a query with count, sum, min, max or avg in its return sentence,
+            // one row per group in the order the groups were first matched
+            std::vector<AggregateRow>
+                aggregate(const GraphSqlSentence&);
+            // the plan of a query, one numbered step per line
+            std::string explain(const GraphSqlSentence&);
+            // runs a query to the end, counting the work of every step of its
+            // plan; an aggregate query counts the bindings it would aggregate
+            QueryProfile profile(const GraphSqlSentence&);
+            // query(q) keeps the rows of up to bytes worth of queries, answering
+            // them again until the next write; 0, the default, turns it off.
+            // Queries with a control or on several threads always run.
+            void setResultCacheSize(std::size_t bytes);
+            ResultCacheStats getResultCacheStats() const;
             virtual void setNode(const NodeType&) override;
             virtual void setEdge(const EdgeType&) override;
             virtual void setNodesBundle(const NodesBundle&) override;
@@ -160,6 +1238,10 @@ namespace netalgo
             void removeEdgeImpl(const EdgeIdType& edgeId,
                         bool updateFromNode,
                         bool updateToNode, leveldb::WriteBatch* batch = nullptr);
+            bool directed() const override
+            {
+                return true;
+            }
             static const std::size_t edgeCacheSize = 1024 * 1024;
             void setInEdge(const NodeIdType& nodeId, inoutEdgesType inEdges,
                         leveldb::WriteBatch *batch = nullptr);
@@ -171,8 +1253,13 @@ namespace netalgo
             inoutEdgesType getOutEdge(const NodeIdType& nodeId);
             NodeType getNode(const NodeIdType &nodeId);
             EdgeType getEdge(const EdgeIdType &edgeId);
+            // the edges leaving (out) or entering nodeId; taken from the inline
+            // adjacency when there is one, which only has their endpoints and
+            // inlined fields
+            std::vector<EdgeType> getAdjacentEdges(const NodeIdType& nodeId, bool out);
         private:
             impl::TypedMRUMap<NodeIdType, inoutEdgesType > outEdgeCache, inEdgeCache;
+            impl::ResultCache<NodeType, EdgeType> resultCache_;
 
     };
 
@@ -192,14 +1279,22 @@ namespace netalgo
 
                 typedef typename InterfaceType::NodesBundle NodesBundle;
                 typedef typename InterfaceType::EdgesBundle EdgesBundle;
-                typedef typename InterfaceType::ResultType ResultType;
+                typedef LevelDbGraphIterator<NodeType, EdgeType, false> ResultType;
                 typedef typename InterfaceType::NodeIdType NodeIdType;
                 typedef typename InterfaceType::EdgeIdType EdgeIdType;
 
-                friend class LevelDbGraphIterator<NodeType, EdgeType>;
+                friend class LevelDbGraphIterator<NodeType, EdgeType, false>;
 
-                virtual typename InterfaceType::ResultType
+                // -- and -[e]- match an edge either way round, so every edge is
+                // found from both of its nodes; <-- and --> are rejected.
+                // Aggregates, shortestPath and the batch, parallel, explain and
+                // profile entry points are only on directed graphs.
+                virtual ResultType
                     query(const GraphSqlSentence&);
+                virtual ResultType
+                    end();
+                ResultType
+                    query(const GraphSqlSentence&, const QueryControl& control);
                 virtual void setNode(const NodeType&) override;
                 virtual void setEdge(const EdgeType&) override;
                 virtual void setNodesBundle(const NodesBundle&) override;
@@ -215,6 +1310,10 @@ namespace netalgo
                             bool updateToNode, leveldb::WriteBatch* batch = nullptr);
                 void setOutEdge(const NodeIdType& nodeId, inoutEdgesType outEdges,
                             leveldb::WriteBatch *batch = nullptr);
+                bool directed() const override
+                {
+                    return false;
+                }
                 static const std::size_t edgeCacheSize = 1024 * 1024;
 
             public:
@@ -363,21 +1462,31 @@ namespace netalgo
                 (s);
         }
 
+    template<typename NodeType, typename EdgeType>
+        std::vector<EdgeType>
+        LevelDbGraph<NodeType, EdgeType, true>::getAdjacentEdges(const NodeIdType& nodeId, bool out)
+        {
+            std::vector<EdgeType> result;
+            if (this->inlineAdjacency_)
+            {
+                impl::InlineEdges inlined = this->getInlineEdges(nodeId, out);
+                result.resize(inlined.size());
+                std::size_t i = 0;
+                for (const auto& stub : inlined)
+                    impl::decodeStub(stub.first, stub.second, result[i++]);
+                return result;
+            }
+            for (const auto& edgeId : out ? getOutEdge(nodeId) : getInEdge(nodeId))
+                result.push_back(getEdge(edgeId));
+            return result;
+        }
+
     template<typename NodeType, typename EdgeType>
         void LevelDbGraph<NodeType, EdgeType, true>::setInEdge(const NodeIdType& nodeId,
                     inoutEdgesType inEdges, leveldb::WriteBatch *batch)
         {
             stringStreamSlice slice = dataToSliceByCereal(inEdges);
-            if (batch == nullptr)
-            {
-                leveldb::Status status = this->db->Put(leveldb::WriteOptions(), addSuffix(nodeId, inEdgeSuffix),
-                            slice.getSlice());
-                assert(status.ok());
-            }
-            else
-            {
-                batch->Put(addSuffix(nodeId, inEdgeSuffix), slice.getSlice());
-            }
+            this->putKey(addSuffix(nodeId, inEdgeSuffix), slice.getSlice(), batch);
 
             inEdgeCache[nodeId] = std::move(inEdges);
         }
@@ -389,16 +1498,7 @@ namespace netalgo
                     inoutEdgesType outEdges, leveldb::WriteBatch *batch)
         {
             stringStreamSlice slice = dataToSliceByCereal(outEdges);
-            if (batch == nullptr)
-            {
-                leveldb::Status status = this->db->Put(leveldb::WriteOptions(), addSuffix(nodeId, outEdgeSuffix),
-                            slice.getSlice());
-                assert(status.ok());
-            }
-            else
-            {
-                batch->Put(addSuffix(nodeId, outEdgeSuffix), slice.getSlice());
-            }
+            this->putKey(addSuffix(nodeId, outEdgeSuffix), slice.getSlice(), batch);
 
             outEdgeCache[nodeId] = std::move(outEdges);
         }
@@ -408,16 +1508,7 @@ namespace netalgo
                     inoutEdgesType outEdges, leveldb::WriteBatch *batch)
         {
             stringStreamSlice slice = dataToSliceByCereal(outEdges);
-            if (batch == nullptr)
-            {
-                leveldb::Status status = this->db->Put(leveldb::WriteOptions(), addSuffix(nodeId, outEdgeSuffix),
-                            slice.getSlice());
-                assert(status.ok());
-            }
-            else
-            {
-                batch->Put(addSuffix(nodeId, outEdgeSuffix), slice.getSlice());
-            }
+            this->putKey(addSuffix(nodeId, outEdgeSuffix), slice.getSlice(), batch);
 
             outEdgeCache[nodeId] = std::move(outEdges);
         }
@@ -426,46 +1517,58 @@ namespace netalgo
     template<typename NodeType, typename EdgeType>
         void LevelDbGraph<NodeType, EdgeType, true>::setNode(const NodeType& node)
         {
-            stringSlice ssslice = dataToSliceByProtobuf(node);
             LOGGER(trace, "Actual added id: {}", addSuffix(node.id(), nodeDataIdSuffix));
             //std::cout << "Actual added id:"<< addSuffix(node.id(), nodeDataIdSuffix) << std::endl;
-            leveldb::Status status = this->db->Put(leveldb::WriteOptions(), addSuffix(node.id(), nodeDataIdSuffix), ssslice.getSlice());
+            leveldb::WriteBatch batch;
+            this->putNodeData(node, nullptr, &batch);
+            leveldb::Status status = this->writeBatch(&batch);
             assert(status.ok());
         }
 
     template<typename NodeType, typename EdgeType>
         void LevelDbGraph<NodeType, EdgeType, false>::setNode(const NodeType& node)
         {
-            stringSlice ssslice = dataToSliceByProtobuf(node);
-            leveldb::Status status = this->db->Put(leveldb::WriteOptions(), addSuffix(node.id(), nodeDataIdSuffix), ssslice.getSlice());
+            leveldb::WriteBatch batch;
+            this->putNodeData(node, nullptr, &batch);
+            leveldb::Status status = this->writeBatch(&batch);
             assert(status.ok());
         }
 
     template<typename NodeType, typename EdgeType>
         void LevelDbGraph<NodeType, EdgeType, true>::setNodesBundle(const NodesBundle& nb)
         {
+            // before any statistics change
+            for (auto& node : nb)
+                checkDataId(node.id());
             leveldb::WriteBatch batch;
+            std::map<NodeIdType, const NodeType*> pending;
             for (auto& node : nb)
             {
-                stringSlice ssslice = dataToSliceByProtobuf(node);
-                batch.Put(addSuffix(node.id(), nodeDataIdSuffix), ssslice.getSlice());
+                auto written = pending.find(node.id());
+                this->putNodeData(node, written == pending.end() ? nullptr : written->second, &batch);
+                pending[node.id()] = &node;
                 LOGGER(trace, "Actual added id: {}", addSuffix(node.id(), nodeDataIdSuffix));
                 //std::cout << "Put " << addSuffix(node.id(), nodeDataIdSuffix) << std::endl;
             }
-            leveldb::Status status = this->db->Write(leveldb::WriteOptions(), &batch);
+            leveldb::Status status = this->writeBatch(&batch);
             assert(status.ok());
         }
 
     template<typename NodeType, typename EdgeType>
         void LevelDbGraph<NodeType, EdgeType, false>::setNodesBundle(const NodesBundle& nb)
         {
+            // before any statistics change
+            for (auto& node : nb)
+                checkDataId(node.id());
             leveldb::WriteBatch batch;
+            std::map<NodeIdType, const NodeType*> pending;
             for (auto& node : nb)
             {
-                stringSlice ssslice = dataToSliceByProtobuf(node);
-                batch.Put(addSuffix(node.id(), nodeDataIdSuffix), ssslice.getSlice());
+                auto written = pending.find(node.id());
+                this->putNodeData(node, written == pending.end() ? nullptr : written->second, &batch);
+                pending[node.id()] = &node;
             }
-            leveldb::Status status = this->db->Write(leveldb::WriteOptions(), &batch);
+            leveldb::Status status = this->writeBatch(&batch);
             assert(status.ok());
         }
 
@@ -482,7 +1585,7 @@ namespace netalgo
 
             // deal with outedge
             inoutEdgesType outSet = getOutEdge(from);
-            outSet.insert(id);
+            bool listed = !outSet.insert(id).second;
             setOutEdge(from, std::move(outSet), &batch);
 
 
@@ -491,11 +1594,13 @@ namespace netalgo
             inSet.insert(id);
             setInEdge(to, std::move(inSet), &batch);
 
+            this->putInlineEdge(from, true, edge, &batch);
+            this->putInlineEdge(to, false, edge, &batch);
+
             //save the edge
-            stringSlice resultproto = dataToSliceByProtobuf(edge);
-            batch.Put(addSuffix(id, edgeDataIdSuffix), resultproto.getSlice());
+            this->putEdgeData(edge, nullptr, &batch, listed);
 
-            status = this->db->Write(leveldb::WriteOptions(), &batch);
+            status = this->writeBatch(&batch);
             assert(status.ok());
         }
 
@@ -512,7 +1617,7 @@ namespace netalgo
 
             // deal with outedge
             inoutEdgesType outSet = getOutEdge(from);
-            outSet.insert(id);
+            bool listed = !outSet.insert(id).second;
             setOutEdge(from, std::move(outSet), &batch);
 
 
@@ -521,11 +1626,13 @@ namespace netalgo
             outSet2.insert(id);
             setOutEdge(to, std::move(outSet2), &batch);
 
+            this->putInlineEdge(from, true, edge, &batch);
+            this->putInlineEdge(to, true, edge, &batch);
+
             //save the edge
-            stringSlice resultproto = dataToSliceByProtobuf(edge);
-            batch.Put(addSuffix(id, edgeDataIdSuffix), resultproto.getSlice());
+            this->putEdgeData(edge, nullptr, &batch, listed);
 
-            status = this->db->Write(leveldb::WriteOptions(), &batch);
+            status = this->writeBatch(&batch);
             assert(status.ok());
         }
 
@@ -535,28 +1642,33 @@ namespace netalgo
             std::string raw;
             leveldb::Status status;
 
-            //save the edge
+            // before any statistics change
+            for (auto& e : eb)
+                checkDataId(e.id());
             leveldb::WriteBatch batch;
+            std::map<EdgeIdType, const EdgeType*> pending;
             for(auto& e : eb)
             {
-                auto result = dataToSliceByProtobuf(e);
-                batch.Put(addSuffix(e.id(), edgeDataIdSuffix), result.getSlice());
-            }
-
-            //deal with outEdge
-            for(auto& e : eb)
-            {
+                //deal with outEdge
                 inoutEdgesType outSet = getOutEdge(e.from());
-                outSet.insert(e.id());
+                bool listed = !outSet.insert(e.id()).second;
                 setOutEdge(e.from(), std::move(outSet), &batch);
 
                 inoutEdgesType inSet = getInEdge(e.to());
                 inSet.insert(e.id());
                 setInEdge(e.to(), std::move(inSet), &batch);
+
+                //save the edge
+                auto written = pending.find(e.id());
+                this->putEdgeData(e, written == pending.end() ? nullptr : written->second, &batch, listed);
+                pending[e.id()] = &e;
+
+                this->putInlineEdge(e.from(), true, e, &batch);
+                this->putInlineEdge(e.to(), false, e, &batch);
             }
 
 
-            status = this->db->Write(leveldb::WriteOptions(), &batch);
+            status = this->writeBatch(&batch);
             assert(status.ok());
         }
 
@@ -566,28 +1678,33 @@ namespace netalgo
             std::string raw;
             leveldb::Status status;
 
-            //save the edge
+            // before any statistics change
+            for (auto& e : eb)
+                checkDataId(e.id());
             leveldb::WriteBatch batch;
+            std::map<EdgeIdType, const EdgeType*> pending;
             for(auto& e : eb)
             {
-                auto result = dataToSliceByProtobuf(e);
-                batch.Put(addSuffix(e.id(), edgeDataIdSuffix), result.getSlice());
-            }
-
-            //deal with outEdge
-            for(auto& e : eb)
-            {
+                //deal with outEdge
                 inoutEdgesType outSet = getOutEdge(e.from());
-                outSet.insert(e.id());
+                bool listed = !outSet.insert(e.id()).second;
                 setOutEdge(e.from(), std::move(outSet), &batch);
 
                 inoutEdgesType outSet2 = getOutEdge(e.to());
                 outSet2.insert(e.id());
                 setOutEdge(e.to(), std::move(outSet2), &batch);
+
+                //save the edge
+                auto written = pending.find(e.id());
+                this->putEdgeData(e, written == pending.end() ? nullptr : written->second, &batch, listed);
+                pending[e.id()] = &e;
+
+                this->putInlineEdge(e.from(), true, e, &batch);
+                this->putInlineEdge(e.to(), true, e, &batch);
             }
 
 
-            status = this->db->Write(leveldb::WriteOptions(), &batch);
+            status = this->writeBatch(&batch);
             assert(status.ok());
         }
 
@@ -598,8 +1715,7 @@ namespace netalgo
             static leveldb::Status status;
             leveldb::WriteBatch batch;
 
-            status = this->db->Delete(leveldb::WriteOptions(), addSuffix(nodeId, nodeDataIdSuffix));
-            assert(status.ok());
+            this->eraseNodeData(nodeId, &batch);
 
             inoutEdgesType inSet = getInEdge(nodeId);
             for (auto& edgeId : inSet)
@@ -607,9 +1723,16 @@ namespace netalgo
 
             inoutEdgesType outSet = getOutEdge(nodeId);
             for (auto& edgeId : outSet)
-                removeEdgeImpl(edgeId, false, true, &batch);
+                if (inSet.find(edgeId) == inSet.end()) // self loops are already gone
+                    removeEdgeImpl(edgeId, false, true, &batch);
 
-            status = this->db->Write(leveldb::WriteOptions(), &batch);
+            this->deleteKey(addSuffix(nodeId, inEdgeSuffix), &batch);
+            this->deleteKey(addSuffix(nodeId, outEdgeSuffix), &batch);
+            inEdgeCache.erase(nodeId);
+            outEdgeCache.erase(nodeId);
+            this->eraseInlineEdges(nodeId, &batch);
+
+            status = this->writeBatch(&batch);
             assert(status.ok());
         }
 
@@ -620,19 +1743,32 @@ namespace netalgo
             static leveldb::Status status;
             leveldb::WriteBatch batch;
 
-            status = this->db->Delete(leveldb::WriteOptions(), addSuffix(nodeId, nodeDataIdSuffix));
-            assert(status.ok());
+            this->eraseNodeData(nodeId, &batch);
 
             inoutEdgesType outSet = getOutEdge(nodeId);
+            // the stubs tell which end of each edge the node is without reading it
+            impl::InlineEdges inlined;
+            if (this->inlineAdjacency_)
+                inlined = this->getInlineEdges(nodeId, true);
             for (auto& edgeId : outSet)
             {
-                if (nodeId == getEdge(edgeId).from())
+                EdgeType edge;
+                auto stub = inlined.find(edgeId);
+                if (stub != inlined.end())
+                    impl::decodeStub(edgeId, stub->second, edge);
+                else
+                    edge = getEdge(edgeId);
+                if (nodeId == edge.from())
                     removeEdgeImpl(edgeId, false, true, &batch);
                 else
                     removeEdgeImpl(edgeId, true, false, &batch);
             }
 
-            status = this->db->Write(leveldb::WriteOptions(), &batch);
+            this->deleteKey(addSuffix(nodeId, outEdgeSuffix), &batch);
+            outEdgeCache.erase(nodeId);
+            this->eraseInlineEdges(nodeId, &batch);
+
+            status = this->writeBatch(&batch);
             assert(status.ok());
         }
 
@@ -665,36 +1801,42 @@ namespace netalgo
             }
             if (!updateFromNode && !updateToNode)
             {
-                status = this->db->Delete(leveldb::WriteOptions(), addSuffix(edgeId, edgeDataIdSuffix));
-                assert(status.ok() || status.IsNotFound());
-            }
-            else
+                if (this->readKey(addSuffix(edgeId, edgeDataIdSuffix), &raw))
+                    this->eraseEdgeData(strToDataByProtobuf<EdgeType>(raw), batch);
+            } else
             {
                 status = this->db->Get(leveldb::ReadOptions(), addSuffix(edgeId, edgeDataIdSuffix), &raw);
                 assert(status.ok() || status.IsNotFound());
                 if (status.IsNotFound())
+                {
+                    if (autoCommit)
+                        delete batch;
                     return;
+                }
                 EdgeType edge = strToDataByProtobuf<EdgeType>(raw);
+                this->eraseEdgeData(edge, batch);
 
                 if (updateFromNode)
                 {
                     inoutEdgesType outEdges = getOutEdge(edge.from());
                     outEdges.erase(edgeId);
                     setOutEdge(edge.from(), std::move(outEdges), batch);
+                    this->eraseInlineEdge(edge.from(), true, edgeId, batch);
                 }
                 if (updateToNode)
                 {
                     inoutEdgesType inEdges = getInEdge(edge.to());
                     inEdges.erase(edgeId);
                     setInEdge(edge.to(), std::move(inEdges), batch);
+                    this->eraseInlineEdge(edge.to(), false, edgeId, batch);
                 }
+            }
 
-                if (autoCommit)
-                {
-                    status = this->db->Write(leveldb::WriteOptions(), batch);
-                    assert(status.ok());
-                    delete batch;
-                }
+            if (autoCommit)
+            {
+                status = this->writeBatch(batch);
+                assert(status.ok());
+                delete batch;
             }
         }
 
@@ -716,42 +1858,52 @@ namespace netalgo
             }
             if (!updateFromNode && !updateToNode)
             {
-                status = this->db->Delete(leveldb::WriteOptions(), addSuffix(edgeId, edgeDataIdSuffix));
-                assert(status.ok() || status.IsNotFound());
-            }
-            else
+                if (this->readKey(addSuffix(edgeId, edgeDataIdSuffix), &raw))
+                    this->eraseEdgeData(strToDataByProtobuf<EdgeType>(raw), batch);
+            } else
             {
                 status = this->db->Get(leveldb::ReadOptions(), addSuffix(edgeId, edgeDataIdSuffix), &raw);
                 assert(status.ok() || status.IsNotFound());
                 if (status.IsNotFound())
+                {
+                    if (autoCommit)
+                        delete batch;
                     return;
+                }
                 EdgeType edge = strToDataByProtobuf<EdgeType>(raw);
+                this->eraseEdgeData(edge, batch);
 
                 if (updateFromNode)
                 {
                     inoutEdgesType outEdges = getOutEdge(edge.from());
                     outEdges.erase(edgeId);
                     setOutEdge(edge.from(), std::move(outEdges), batch);
+                    this->eraseInlineEdge(edge.from(), true, edgeId, batch);
                 }
                 if (updateToNode)
                 {
                     inoutEdgesType inEdges = getOutEdge(edge.to());
                     inEdges.erase(edgeId);
                     setOutEdge(edge.to(), std::move(inEdges), batch);
+                    this->eraseInlineEdge(edge.to(), true, edgeId, batch);
                 }
+            }
 
-                if (autoCommit)
-                {
-                    status = this->db->Write(leveldb::WriteOptions(), batch);
-                    assert(status.ok());
-                    delete batch;
-                }
+            if (autoCommit)
+            {
+                status = this->writeBatch(batch);
+                assert(status.ok());
+                delete batch;
             }
         }
 }
 
 #include "leveldbgraph_deduction.inc"
 #include "leveldbgraph_iterator.inc"
+#include "leveldbgraph_batch.inc"
+#include "leveldbgraph_parallel.inc"
+#include "leveldbgraph_aggregate.inc"
+#include "leveldbgraph_path.inc"
 
 namespace netalgo
 {
@@ -759,17 +1911,71 @@ namespace netalgo
         typename LevelDbGraph<NodeType, EdgeType, true>::ResultType
         LevelDbGraph<NodeType, EdgeType, true>::query(const GraphSqlSentence& q)
         {
-            return LevelDbGraphIterator<NodeType, EdgeType, true>(*this, q);
+            typedef typename impl::ResultCache<NodeType, EdgeType>::Rows Rows;
+            if (resultCache_.capacity() == 0 || !q.second.aggregates.empty())
+                return LevelDbGraphIterator<NodeType, EdgeType, true>(*this, q);
+            std::string key = impl::sentenceKey(q);
+            std::shared_ptr<const Rows> rows = resultCache_.find(key, this->writeVersion_);
+            if (!rows)
+            {
+                std::uint64_t version = this->writeVersion_;
+                std::shared_ptr<Rows> computed = std::make_shared<Rows>();
+                LevelDbGraphBatch<NodeType, EdgeType> batch;
+                if (q.first.shortestPath)
+                {
+                    impl::ShortestPath<NodeType, EdgeType>(*this, q).fill(batch);
+                    if (!batch.empty())
+                        computed->push_back(batch);
+                } else
+                {
+                    BatchCursorType cursor(*this, q, 1024);
+                    while (cursor.next(batch))
+                        computed->push_back(batch);
+                }
+                resultCache_.insert(key, version, computed);
+                rows = computed;
+            }
+            return LevelDbGraphIterator<NodeType, EdgeType, true>(*this, q, rows);
+        }
+
+    template<typename NodeType, typename EdgeType>
+        void LevelDbGraph<NodeType, EdgeType, true>::setResultCacheSize(std::size_t bytes)
+        {
+            resultCache_.setCapacity(bytes);
+        }
+
+    template<typename NodeType, typename EdgeType>
+        ResultCacheStats LevelDbGraph<NodeType, EdgeType, true>::getResultCacheStats() const
+        {
+            return resultCache_.stats();
+        }
+
+    template<typename NodeType, typename EdgeType>
+        typename LevelDbGraph<NodeType, EdgeType, true>::ResultType
+        LevelDbGraph<NodeType, EdgeType, true>::query(const GraphSqlSentence& q, const QueryControl& control)
+        {
+            return LevelDbGraphIterator<NodeType, EdgeType, true>(*this, q, control);
         }
 
     template<typename NodeType, typename EdgeType>
         typename LevelDbGraph<NodeType, EdgeType, false>::ResultType
         LevelDbGraph<NodeType, EdgeType, false>::query(const GraphSqlSentence& q)
         {
-            using namespace impl;
-            throw std::runtime_error("Query not implemented yet");
-            LevelDbGraphIterator<NodeType, EdgeType, false> it(*this);
-            DeductionStepsType deductionSteps = generateDeductionSteps(q);
+            return LevelDbGraphIterator<NodeType, EdgeType, false>(*this, q);
+        }
+
+    template<typename NodeType, typename EdgeType>
+        typename LevelDbGraph<NodeType, EdgeType, false>::ResultType
+        LevelDbGraph<NodeType, EdgeType, false>::query(const GraphSqlSentence& q, const QueryControl& control)
+        {
+            return LevelDbGraphIterator<NodeType, EdgeType, false>(*this, q, control);
+        }
+
+    template<typename NodeType, typename EdgeType>
+        typename LevelDbGraph<NodeType, EdgeType, false>::ResultType
+        LevelDbGraph<NodeType, EdgeType, false>::end()
+        {
+            return LevelDbGraphIterator<NodeType, EdgeType, false>(*this);
         }
 
     template<typename NodeType, typename EdgeType>
@@ -779,6 +1985,94 @@ namespace netalgo
             return LevelDbGraphIterator<NodeType, EdgeType, true>(*this);
         }
 
+    template<typename NodeType, typename EdgeType>
+        typename LevelDbGraph<NodeType, EdgeType, true>::ResultType
+        LevelDbGraph<NodeType, EdgeType, true>::query(const GraphSqlSentence& q,
+                    std::size_t parallelism, bool ordered, const QueryControl& control)
+        {
+            if (parallelism <= 1 || q.first.shortestPath)
+                return query(q, control);
+            return LevelDbGraphIterator<NodeType, EdgeType, true>(*this, q, parallelism, ordered, control);
+        }
+
+    template<typename NodeType, typename EdgeType>
+    template<typename Sink>
+        std::size_t LevelDbGraph<NodeType, EdgeType, true>::execute(const GraphSqlSentence& q,
+                    Sink sink, std::size_t parallelism)
+        {
+            std::size_t count = 0;
+            // ordered, so that stopping early sees the same results as query(q)
+            for (auto it = query(q, parallelism, true); it != end(); ++it)
+            {
+                ++count;
+                if (!impl::feedSink(sink, *it))
+                    break;
+            }
+            return count;
+        }
+
+    template<typename NodeType, typename EdgeType>
+        typename LevelDbGraph<NodeType, EdgeType, true>::BatchCursorType
+        LevelDbGraph<NodeType, EdgeType, true>::queryBatches(const GraphSqlSentence& q,
+                    std::size_t batchSize, const QueryControl& control)
+        {
+            return LevelDbGraphBatchCursor<NodeType, EdgeType>(*this, q, batchSize, control);
+        }
+
+    template<typename NodeType, typename EdgeType>
+        std::vector<AggregateRow> LevelDbGraph<NodeType, EdgeType, true>::aggregate(const GraphSqlSentence& q)
+        {
+            return impl::Aggregation<NodeType, EdgeType>(q).run(*this);
+        }
+
+    template<typename NodeType, typename EdgeType>
+        std::string LevelDbGraph<NodeType, EdgeType, true>::explain(const GraphSqlSentence& q)
+        {
+            std::vector<std::string> steps;
+            if (q.first.shortestPath)
+                steps.push_back(impl::ShortestPath<NodeType, EdgeType>(*this, q).describe());
+            else
+                steps = BatchCursorType(*this, q, 1).describe();
+            std::ostringstream os;
+            for (std::size_t i = 0; i < steps.size(); ++i)
+                os << i << ": " << steps[i] << '\n';
+            return os.str();
+        }
+
+    template<typename NodeType, typename EdgeType>
+        QueryProfile LevelDbGraph<NodeType, EdgeType, true>::profile(const GraphSqlSentence& q)
+        {
+            QueryProfile result;
+            auto start = std::chrono::steady_clock::now();
+            if (q.first.shortestPath)
+            {
+                impl::ShortestPath<NodeType, EdgeType> path(*this, q);
+                LevelDbGraphBatch<NodeType, EdgeType> batch;
+                path.fill(batch);
+                StepProfile step;
+                step.step = path.describe();
+                // the nodes whose adjacency lists the search read
+                step.candidates = path.explored();
+                result.steps.push_back(step);
+                result.rows = batch.rows;
+            } else
+            {
+                GraphSqlSentence sql = q;
+                if (!sql.second.aggregates.empty())
+                {
+                    sql.second.aggregates.clear();
+                    sql.second.limit = noLimit;
+                }
+                BatchCursorType cursor(*this, sql, 1024);
+                cursor.profile(result);
+                LevelDbGraphBatch<NodeType, EdgeType> batch;
+                while (cursor.next(batch))
+                    result.rows += batch.rows;
+            }
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return result;
+        }
+
 }
 
 #endif
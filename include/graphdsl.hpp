@@ -1,18 +1,24 @@
 #ifndef GRAPHDSL_HPP
 #define GRAPHDSL_HPP
 #include <vector>
+#include <cstddef>
 #include <tuple>
 #include <string>
 #include <exception>
 #include <memory>
+#include <map>
+#include <sstream>
+#include <type_traits>
 #include "debug.hpp"
 
 /**************************************************************************************************************
  *                                          pair<> GraphSqlSentence
  *                       first) SelectSentence                                             second) ReturnSentence
  * vector<NodeType> nodes;              vector<EdgeType> edges;                          vector<string> returnName;
- * string id; Properties properties;    EdgeDirection direction; Properties properties;
- *            name:str Rel value:str    prev,next,bidir          name:str Rel value:str
+ * string id; Properties properties;    EdgeDirection direction; Properties properties;  vector<Aggregate> aggregates;
+ *            name:str Rel value:str    prev,next,bidir          name:str Rel value:str  size_t limit;
+ * vector<string> labels;               bool variableLength; size_t minHops, maxHops;
+ * bool shortestPath; string weight;
  **************************************************************************************************************/
 namespace netalgo
 {
@@ -30,6 +36,8 @@ namespace netalgo
     struct NodeType
     {
         std::string id;
+        // (a:Paper:Journal) matches the nodes carrying every one of these
+        std::vector<std::string> labels;
         Properties properties;
     };
 
@@ -39,22 +47,110 @@ namespace netalgo
         std::string id;
         EdgeDirection direction;
         Properties properties;
+        // -[*min..max]-> matches the nodes reachable in min to max steps,
+        // each once, and binds no edge; maxHops is noLimit for -[*]->
+        bool variableLength = false;
+        std::size_t minHops = 1, maxHops = 1;
     };
 
+    const std::size_t noLimit = static_cast<std::size_t>(-1);
+
     struct SelectSentence
     {
         std::vector<NodeType> nodes;
         std::vector<EdgeType> edges;
+        // shortestPath((a)-[p*]->(b)): one path from a to b with the fewest
+        // edges, or the smallest sum of the numeric edge field weight when set
+        bool shortestPath = false;
+        std::string weight;
+    };
+
+    enum AggregateFunction { countAll, countBound, countDistinct, sumOf, minOf, maxOf, avgOf };
+
+    // count(*), count(a), count(distinct a), sum(a.field), min, max or avg
+    struct Aggregate
+    {
+        AggregateFunction function;
+        std::string name; // node or edge, empty for count(*)
+        std::string field; // numeric field of name, for sum, min, max and avg
     };
 
     struct ReturnSentence
     {
+        // with aggregates these are the group keys
         std::vector<std::string> returnName;
+        std::vector<Aggregate> aggregates;
+        std::size_t limit = noLimit; // at most this many results, from "limit N"
     };
 
     typedef std::pair<SelectSentence, ReturnSentence> GraphSqlSentence;
 
-    const GraphSqlSentence& parseGraphSql(const char* s); 
+    // Parses s, or returns the sentence parsed earlier from the same text.
+    // The cache is shared by all threads and keeps the most recently used texts.
+    std::shared_ptr<const GraphSqlSentence> parseGraphSql(const std::string& s);
+
+    // values for the $name placeholders of a prepared sentence
+    class GraphSqlParameters
+    {
+        private:
+            std::map<std::string, std::string> values_; // as constants of the sentence
+        public:
+            GraphSqlParameters& set(const std::string& name, const std::string& value)
+            {
+                values_[name] = '"' + value + '"';
+                return *this;
+            }
+            GraphSqlParameters& set(const std::string& name, const char* value)
+            {
+                return set(name, std::string(value));
+            }
+            GraphSqlParameters& set(const std::string& name, bool value)
+            {
+                values_[name] = value ? "true" : "false";
+                return *this;
+            }
+            template<typename T>
+                typename std::enable_if<std::is_arithmetic<T>::value, GraphSqlParameters&>::type
+                set(const std::string& name, T value)
+                {
+                    std::ostringstream os;
+                    os.precision(17);
+                    os << +value;
+                    values_[name] = os.str();
+                    return *this;
+                }
+            const std::string* find(const std::string& name) const
+            {
+                auto it = values_.find(name);
+                return it == values_.end() ? nullptr : &it->second;
+            }
+    };
+
+    // A sentence parsed once whose property constants may be $name
+    // placeholders, filled in by bind() for every execution.
+    class PreparedGraphSql
+    {
+        private:
+            struct Placeholder
+            {
+                bool isNode;
+                std::size_t element, property;
+                std::string name; // without $
+            };
+            std::shared_ptr<const GraphSqlSentence> sentence_;
+            std::vector<Placeholder> placeholders_;
+        public:
+            explicit PreparedGraphSql(const std::string& s);
+            // names of the placeholders, in order of first appearance
+            std::vector<std::string> parameters() const;
+            // throws GraphSqlParseException when a placeholder has no value
+            GraphSqlSentence bind(const GraphSqlParameters& values) const;
+            const GraphSqlSentence& sentence() const
+            {
+                return *sentence_;
+            }
+    };
+
     class GraphSqlParseException : public std::exception
     {
         protected:
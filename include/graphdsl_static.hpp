@@ -0,0 +1,474 @@
+#ifndef GRAPHDSL_STATIC_HPP
+#define GRAPHDSL_STATIC_HPP
+#include "graphdsl.hpp"
+#include <cstddef>
+
+/**************************************************************************************************************
+ * Compile time checking of graphsql literals. checkGraphSql follows the grammar of parseGraphSql and the
+ * names allowed in return sentence; GRAPHSQL("...") fails the build when the literal would not parse and
+ * otherwise gives the sentence of "..."_graphsql. Rules about the whole return sentence, such as group by
+ * listing every returned name, are still checked by the parser.
+ *
+ * Compilers bound how deeply constant expressions nest calls, 512 by default (-fconstexpr-depth). Runs of
+ * characters, such as strings, names, numbers and spaces, are scanned by halves and nest O(log n) deep,
+ * while every hop, label, property, return item and escape in a string adds a few levels, so a literal
+ * with more than about a hundred of them needs a deeper limit or the run time "..."_graphsql.
+ **************************************************************************************************************/
+namespace netalgo
+{
+    namespace impl
+    {
+        namespace graphsqlcheck
+        {
+            // a position after what was parsed, or minus an Error
+            typedef long Pos;
+            enum Error { ok, noSelect, badNode, badProperty, badEdge, noReturn, badReturn, unknownName,
+                badAggregate, badLimit, trailing, badPath };
+
+            constexpr Pos fail(Error e) { return -static_cast<Pos>(e); }
+
+            constexpr bool isSpace(char c)
+            {
+                return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+            }
+            constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+            constexpr bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+            constexpr bool isIdentChar(char c) { return isAlpha(c) || isDigit(c) || c == '_'; }
+            constexpr bool startsIdent(char c) { return isAlpha(c) || c == ':' || c == '_'; }
+            constexpr bool isOp(char c) { return c == '<' || c == '=' || c == '>'; }
+            constexpr bool isSign(char c) { return c == '+' || c == '-'; }
+            constexpr bool inString(char c) { return c != '"' && c != '\\' && c != '\0'; }
+            constexpr char lower(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+            // the first position in [p, p + n) where Pred fails, or p + n, looking at the halves in
+            // turn; the halves after a failing character, and so the end of s, are never read
+            template<bool (*Pred)(char)>
+                constexpr Pos spanIn(const char* s, Pos p, Pos n);
+            template<bool (*Pred)(char)>
+                constexpr Pos spanRest(const char* s, Pos m, Pos p, Pos n)
+                {
+                    return m < p + n / 2 ? m : spanIn<Pred>(s, p + n / 2, n - n / 2);
+                }
+            template<bool (*Pred)(char)>
+                constexpr Pos spanIn(const char* s, Pos p, Pos n)
+                {
+                    return n == 1 ? (Pred(s[p]) ? p + 1 : p) : spanRest<Pred>(s, spanIn<Pred>(s, p, n / 2), p, n);
+                }
+            // the end of the run of Pred from p, in blocks of doubling size
+            template<bool (*Pred)(char)>
+                constexpr Pos span(const char* s, Pos p, Pos n = 1);
+            template<bool (*Pred)(char)>
+                constexpr Pos spanFrom(const char* s, Pos m, Pos p, Pos n)
+                {
+                    return m < p + n ? m : span<Pred>(s, p + n, n * 2);
+                }
+            template<bool (*Pred)(char)>
+                constexpr Pos span(const char* s, Pos p, Pos n)
+                {
+                    return spanFrom<Pred>(s, spanIn<Pred>(s, p, n), p, n);
+                }
+
+            constexpr Pos skip(const char* s, Pos p) { return span<isSpace>(s, p); }
+            constexpr Pos identEnd(const char* s, Pos p) { return span<isIdentChar>(s, p); }
+
+            // the word w in small letters, as a whole identifier
+            constexpr bool wordAt(const char* s, Pos p, const char* w)
+            {
+                return *w == '\0' ? !isIdentChar(s[p]) : lower(s[p]) == *w && wordAt(s, p + 1, w + 1);
+            }
+            constexpr bool isKeyword(const char* s, Pos p)
+            {
+                return wordAt(s, p, "select") || wordAt(s, p, "return");
+            }
+            constexpr bool isIdentifier(const char* s, Pos p)
+            {
+                return startsIdent(s[p]) && !isKeyword(s, p);
+            }
+            constexpr bool sameChars(const char* s, Pos a, Pos b, Pos n)
+            {
+                return n <= 1 ? n == 0 || s[a] == s[b] :
+                    sameChars(s, a, b, n / 2) && sameChars(s, a + n / 2, b + n / 2, n - n / 2);
+            }
+            constexpr bool sameIdent(const char* s, Pos a, Pos b)
+            {
+                return identEnd(s, a) - a == identEnd(s, b) - b && sameChars(s, a, b, identEnd(s, a) - a);
+            }
+            // a lone -, not the sign of a number
+            constexpr bool isDash(const char* s, Pos p)
+            {
+                return s[p] == '-' && !isDigit(s[p + 1]) && s[p + 1] != '.' && s[p + 1] != '+';
+            }
+
+            // constants
+            constexpr Pos stringEnd(const char* s, Pos p);
+            constexpr Pos stringAt(const char* s, Pos q)
+            {
+                return s[q] == '\0' ? fail(badProperty) :
+                    s[q] == '\\' ? (s[q + 1] == '\0' ? fail(badProperty) : stringEnd(s, q + 2)) : q + 1;
+            }
+            constexpr Pos stringEnd(const char* s, Pos p)
+            {
+                return stringAt(s, span<inString>(s, p));
+            }
+            constexpr Pos digitsEnd(const char* s, Pos p)
+            {
+                return span<isDigit>(s, p);
+            }
+            // digits, then at most one . and digits, with a digit somewhere; p is where they start
+            constexpr Pos fractionEnd(const char* s, Pos p, Pos q)
+            {
+                return s[q] == '.' || q - p < 2 ? fail(badProperty) : q;
+            }
+            constexpr Pos integerEnd(const char* s, Pos p, Pos q)
+            {
+                return s[q] == '.' ? fractionEnd(s, p, digitsEnd(s, q + 1)) : q > p ? q : fail(badProperty);
+            }
+            constexpr Pos numberEnd(const char* s, Pos p)
+            {
+                return integerEnd(s, p, digitsEnd(s, p));
+            }
+            constexpr Pos constantAt(const char* s, Pos p)
+            {
+                return s[p] == '"' ? stringEnd(s, p + 1) :
+                    s[p] == '$' ? (startsIdent(s[p + 1]) ? identEnd(s, p + 2) : fail(badProperty)) :
+                    isDigit(s[p]) || s[p] == '.' || s[p] == '+' || (s[p] == '-' && !isDash(s, p)) ?
+                    numberEnd(s, span<isSign>(s, p)) : fail(badProperty);
+            }
+
+            // name op constant
+            constexpr Pos propertyOp(const char* s, Pos p)
+            {
+                return isOp(s[p]) ? constantAt(s, skip(s, p + 1)) : fail(badProperty);
+            }
+            constexpr Pos propertyAt(const char* s, Pos p)
+            {
+                return isIdentifier(s, p) ? propertyOp(s, skip(s, identEnd(s, p + 1))) : fail(badProperty);
+            }
+            constexpr Pos properties(const char* s, Pos p, char terminator);
+            constexpr Pos propertiesAt(const char* s, Pos p, char terminator)
+            {
+                return s[p] == terminator ? p + 1 :
+                    s[p] == '\0' ? fail(badProperty) : properties(s, propertyAt(s, p), terminator);
+            }
+            constexpr Pos properties(const char* s, Pos p, char terminator)
+            {
+                return p < 0 ? p : propertiesAt(s, skip(s, p), terminator);
+            }
+
+            // inside () or [], an optional id and then properties
+            constexpr Pos elementAt(const char* s, Pos p, char terminator, Error e)
+            {
+                return s[p] == terminator ? p + 1 :
+                    !isIdentifier(s, p) ? fail(e) :
+                    s[p] != ':' && !isOp(s[skip(s, identEnd(s, p + 1))]) ?
+                    properties(s, identEnd(s, p + 1), terminator) : properties(s, p, terminator);
+            }
+            // a node may name labels, :Label, between the id and the properties
+            constexpr bool isLabel(const char* s, Pos p)
+            {
+                return s[p] == ':' && !isOp(s[skip(s, identEnd(s, p + 1))]);
+            }
+            constexpr Pos labels(const char* s, Pos p);
+            constexpr Pos labelsAt(const char* s, Pos p)
+            {
+                return !isLabel(s, p) ? properties(s, p, ')') :
+                    identEnd(s, p + 1) == p + 1 ? fail(badNode) : labels(s, identEnd(s, p + 1));
+            }
+            constexpr Pos labels(const char* s, Pos p)
+            {
+                return labelsAt(s, skip(s, p));
+            }
+            constexpr Pos nodeElementAt(const char* s, Pos p)
+            {
+                return s[p] == ')' ? p + 1 :
+                    !isIdentifier(s, p) ? fail(badNode) :
+                    s[p] != ':' && !isOp(s[skip(s, identEnd(s, p + 1))]) ?
+                    labels(s, identEnd(s, p + 1)) : labels(s, p);
+            }
+            constexpr Pos nodeAt(const char* s, Pos p)
+            {
+                return s[p] == '(' ? nodeElementAt(s, skip(s, p + 1)) : fail(badNode);
+            }
+            constexpr Pos node(const char* s, Pos p)
+            {
+                return p < 0 ? p : nodeAt(s, skip(s, p));
+            }
+
+            // -, --, -->, -[...]-, -[...]->, <--, <-[...]-, where [...] may be [*hops]
+            constexpr Pos arrow(const char* s, Pos p, bool left)
+            {
+                return s[skip(s, p)] != '>' ? p : left ? fail(badEdge) : skip(s, p) + 1;
+            }
+            constexpr Pos edgeEnd(const char* s, Pos p, bool left)
+            {
+                return p < 0 ? p : isDash(s, skip(s, p)) ? arrow(s, skip(s, p) + 1, left) : fail(badEdge);
+            }
+            // *N or *min..max with 0 < max and min <= max, then ]; a path also takes * and
+            // needs min <= 1
+            constexpr unsigned long long square(unsigned long long x) { return x * x; }
+            constexpr unsigned long long power10(Pos n)
+            {
+                return n == 0 ? 1 : n % 2 ? 10 * power10(n - 1) : square(power10(n / 2));
+            }
+            // the n digits from p
+            constexpr unsigned long long digitsValue(const char* s, Pos p, Pos n)
+            {
+                return n == 1 ? s[p] - '0' :
+                    digitsValue(s, p, n / 2) * power10(n - n / 2) + digitsValue(s, p + n / 2, n - n / 2);
+            }
+            constexpr unsigned long long digitsValue(const char* s, Pos p)
+            {
+                return digitsValue(s, p, digitsEnd(s, p) - p);
+            }
+            constexpr bool isRange(const char* s, Pos p)
+            {
+                return s[p] == '.' && s[p + 1] == '.';
+            }
+            constexpr Pos hopsClose(const char* s, Pos p, unsigned long long low, unsigned long long high,
+                        bool path)
+            {
+                return high == 0 || low > high || (path && low > 1) || s[p] != ']' ? fail(badEdge) : p + 1;
+            }
+            constexpr Pos hopsMax(const char* s, Pos q, unsigned long long low, bool path)
+            {
+                return isDigit(s[q]) && s[digitsEnd(s, q)] != '.' ?
+                    hopsClose(s, skip(s, digitsEnd(s, q)), low, digitsValue(s, q), path) : fail(badEdge);
+            }
+            constexpr Pos hopsRange(const char* s, Pos p, unsigned long long low, bool path)
+            {
+                return isRange(s, p) ? hopsMax(s, skip(s, p + 2), low, path) : hopsClose(s, p, low, low, path);
+            }
+            constexpr Pos hopsAt(const char* s, Pos q, bool path)
+            {
+                return path && s[q] == ']' ? q + 1 :
+                    isDigit(s[q]) && (s[digitsEnd(s, q)] != '.' || isRange(s, digitsEnd(s, q))) ?
+                    hopsRange(s, skip(s, digitsEnd(s, q)), digitsValue(s, q), path) : fail(badEdge);
+            }
+            constexpr Pos bracketAt(const char* s, Pos q)
+            {
+                return s[q] == '*' ? hopsAt(s, skip(s, q + 1), false) : elementAt(s, q, ']', badEdge);
+            }
+            constexpr Pos afterDashAt(const char* s, Pos p, Pos q, bool left)
+            {
+                return isDash(s, q) ? arrow(s, q + 1, left) :
+                    s[q] == '[' ? edgeEnd(s, bracketAt(s, skip(s, q + 1)), left) : p;
+            }
+            constexpr Pos afterDash(const char* s, Pos p, bool left)
+            {
+                return afterDashAt(s, p, skip(s, p), left);
+            }
+            constexpr Pos edgeAt(const char* s, Pos p)
+            {
+                return s[p] == '<' ?
+                    (isDash(s, skip(s, p + 1)) ? afterDash(s, skip(s, p + 1) + 1, true) : fail(badEdge)) :
+                    isDash(s, p) ? afterDash(s, p + 1, false) : fail(badEdge);
+            }
+            constexpr Pos pattern(const char* s, Pos p);
+            constexpr Pos patternAt(const char* s, Pos p, Pos q)
+            {
+                return s[q] == '-' || s[q] == '<' ? pattern(s, node(s, edgeAt(s, q))) : p;
+            }
+            constexpr Pos pattern(const char* s, Pos p)
+            {
+                return p < 0 ? p : patternAt(s, p, skip(s, p));
+            }
+
+            // names declared in the pattern between b and e
+            constexpr bool declaresAt(const char* s, Pos q, Pos n)
+            {
+                return isIdentifier(s, q) && s[q] != ':' && sameIdent(s, q, n) &&
+                    !isOp(s[skip(s, identEnd(s, q))]);
+            }
+            constexpr bool declared(const char* s, Pos b, Pos e, Pos n)
+            {
+                return e - b > 1 ? declared(s, b, b + (e - b) / 2, n) || declared(s, b + (e - b) / 2, e, n) :
+                    b < e && (s[b] == '(' || s[b] == '[') && declaresAt(s, skip(s, b + 1), n);
+            }
+            constexpr Pos declaredNameAt(const char* s, Pos q, Pos b, Pos e)
+            {
+                return isIdentifier(s, q) && s[q] != ':' && declared(s, b, e, q) ?
+                    identEnd(s, q) : fail(unknownName);
+            }
+            constexpr Pos declaredName(const char* s, Pos p, Pos b, Pos e)
+            {
+                return p < 0 ? p : declaredNameAt(s, skip(s, p), b, e);
+            }
+
+            // count(*), count(a), count(distinct a), sum(a.field), min, max, avg
+            constexpr Pos closeAt(const char* s, Pos q)
+            {
+                return s[q] == ')' ? q + 1 : fail(badAggregate);
+            }
+            constexpr Pos close(const char* s, Pos p)
+            {
+                return p < 0 ? p : closeAt(s, skip(s, p));
+            }
+            constexpr Pos fieldAt(const char* s, Pos q)
+            {
+                return s[q] == '.' && !isDigit(s[q + 1]) && isIdentifier(s, skip(s, q + 1)) ?
+                    identEnd(s, skip(s, q + 1)) : fail(badAggregate);
+            }
+            constexpr Pos field(const char* s, Pos p)
+            {
+                return p < 0 ? p : fieldAt(s, skip(s, p));
+            }
+            constexpr Pos countAt(const char* s, Pos q, Pos b, Pos e)
+            {
+                return s[q] == '*' ? close(s, q + 1) :
+                    wordAt(s, q, "distinct") && isIdentifier(s, skip(s, q + 8)) ?
+                    close(s, declaredName(s, q + 8, b, e)) : close(s, declaredName(s, q, b, e));
+            }
+            constexpr Pos aggregateAt(const char* s, Pos f, Pos q, Pos b, Pos e)
+            {
+                return wordAt(s, f, "count") ? countAt(s, q, b, e) :
+                    wordAt(s, f, "sum") || wordAt(s, f, "min") || wordAt(s, f, "max") || wordAt(s, f, "avg") ?
+                    close(s, field(s, declaredName(s, q, b, e))) : fail(badAggregate);
+            }
+            constexpr Pos returnItemAt(const char* s, Pos q, Pos b, Pos e)
+            {
+                return !isIdentifier(s, q) ? fail(badReturn) :
+                    s[skip(s, identEnd(s, q))] == '(' ?
+                    aggregateAt(s, q, skip(s, skip(s, identEnd(s, q)) + 1), b, e) : declaredName(s, q, b, e);
+            }
+            constexpr Pos returnItems(const char* s, Pos p, Pos b, Pos e)
+            {
+                return p < 0 ? p : s[skip(s, p)] == ',' ?
+                    returnItems(s, returnItemAt(s, skip(s, skip(s, p) + 1), b, e), b, e) : p;
+            }
+            constexpr Pos names(const char* s, Pos p, Pos b, Pos e)
+            {
+                return p < 0 ? p : s[skip(s, p)] == ',' ? names(s, declaredName(s, skip(s, p) + 1, b, e), b, e) : p;
+            }
+            constexpr Pos groupByAt(const char* s, Pos p, Pos q, Pos b, Pos e)
+            {
+                return wordAt(s, q, "group") && wordAt(s, skip(s, q + 5), "by") ?
+                    names(s, declaredName(s, skip(s, q + 5) + 2, b, e), b, e) : p;
+            }
+            constexpr Pos groupBy(const char* s, Pos p, Pos b, Pos e)
+            {
+                return p < 0 ? p : groupByAt(s, p, skip(s, p), b, e);
+            }
+            constexpr Pos limitNumber(const char* s, Pos q)
+            {
+                return isDigit(s[q]) && s[digitsEnd(s, q)] != '.' ? digitsEnd(s, q) : fail(badLimit);
+            }
+            constexpr Pos limitAt(const char* s, Pos p, Pos q)
+            {
+                return wordAt(s, q, "limit") ? limitNumber(s, skip(s, q + 5)) : p;
+            }
+            constexpr Pos limit(const char* s, Pos p)
+            {
+                return p < 0 ? p : limitAt(s, p, skip(s, p));
+            }
+            constexpr Pos end(const char* s, Pos p)
+            {
+                return p < 0 ? p : s[skip(s, p)] == '\0' ? skip(s, p) : fail(trailing);
+            }
+
+            // b is where the pattern starts, e where return is
+            constexpr Pos returnAt(const char* s, Pos b, Pos e)
+            {
+                return e < 0 ? e : !wordAt(s, skip(s, e), "return") ? fail(noReturn) :
+                    end(s, limit(s, groupBy(s,
+                                    returnItems(s, returnItemAt(s, skip(s, skip(s, e) + 6), b, e), b, e), b, e)));
+            }
+
+            // shortestPath((a)-[p*]->(b)) or shortestPath((a)<-[p*..5]-(b), weight), after the first (
+            constexpr Pos pathHopsAt(const char* s, Pos q)
+            {
+                return s[q] == '*' ? hopsAt(s, skip(s, q + 1), true) :
+                    isIdentifier(s, q) && s[q] != ':' && s[skip(s, identEnd(s, q + 1))] == '*' ?
+                    hopsAt(s, skip(s, skip(s, identEnd(s, q + 1)) + 1), true) : fail(badPath);
+            }
+            constexpr Pos pathBracket(const char* s, Pos q)
+            {
+                return s[q] == '[' ? pathHopsAt(s, skip(s, q + 1)) : fail(badPath);
+            }
+            // the dash after ], followed by > unless the path points left
+            constexpr Pos pathArrow(const char* s, Pos p, bool left)
+            {
+                return p < 0 ? p : !isDash(s, skip(s, p)) ? fail(badPath) :
+                    (s[skip(s, skip(s, p) + 1)] == '>') == left ? fail(badPath) :
+                    left ? skip(s, p) + 1 : skip(s, skip(s, p) + 1) + 1;
+            }
+            constexpr Pos pathEdgeAt(const char* s, Pos p)
+            {
+                return s[p] == '<' && isDash(s, skip(s, p + 1)) ?
+                    pathArrow(s, pathBracket(s, skip(s, skip(s, p + 1) + 1)), true) :
+                    isDash(s, p) ? pathArrow(s, pathBracket(s, skip(s, p + 1)), false) : fail(badPath);
+            }
+            constexpr Pos pathEdge(const char* s, Pos p)
+            {
+                return p < 0 ? p : pathEdgeAt(s, skip(s, p));
+            }
+            constexpr Pos pathCloseAt(const char* s, Pos q)
+            {
+                return s[q] == ')' ? q + 1 : fail(badPath);
+            }
+            constexpr Pos pathWeightAt(const char* s, Pos q)
+            {
+                return startsIdent(s[q]) && !isKeyword(s, q) ? pathCloseAt(s, skip(s, identEnd(s, q + 1))) :
+                    fail(badPath);
+            }
+            constexpr Pos pathEndAt(const char* s, Pos q)
+            {
+                return s[q] == ',' ? pathWeightAt(s, skip(s, q + 1)) : pathCloseAt(s, q);
+            }
+            constexpr Pos pathEnd(const char* s, Pos p)
+            {
+                return p < 0 ? p : pathEndAt(s, skip(s, p));
+            }
+            constexpr Pos pathAt(const char* s, Pos q)
+            {
+                return pathEnd(s, node(s, pathEdge(s, node(s, q))));
+            }
+
+            // b is where the pattern starts, q the first token after select
+            constexpr Pos selectAt(const char* s, Pos b, Pos q)
+            {
+                return wordAt(s, q, "shortestpath") && s[skip(s, q + 12)] == '(' ?
+                    returnAt(s, b, pathAt(s, skip(s, q + 12) + 1)) : returnAt(s, b, pattern(s, node(s, b)));
+            }
+            constexpr Pos sentenceAt(const char* s, Pos p)
+            {
+                return wordAt(s, p, "select") ? selectAt(s, p + 6, skip(s, p + 6)) : fail(noSelect);
+            }
+        }
+
+        // 0 when s parses, otherwise the graphsqlcheck::Error found first
+        constexpr int checkGraphSql(const char* s)
+        {
+            return graphsqlcheck::sentenceAt(s, graphsqlcheck::skip(s, 0)) < 0 ?
+                static_cast<int>(-graphsqlcheck::sentenceAt(s, graphsqlcheck::skip(s, 0))) : 0;
+        }
+
+        template<int Error>
+            struct StaticGraphSql
+            {
+                static_assert(Error != graphsqlcheck::noSelect, "graphsql: the first token must be select");
+                static_assert(Error != graphsqlcheck::badNode, "graphsql: malformed node");
+                static_assert(Error != graphsqlcheck::badProperty, "graphsql: malformed property");
+                static_assert(Error != graphsqlcheck::badEdge, "graphsql: malformed edge");
+                static_assert(Error != graphsqlcheck::noReturn, "graphsql: return doesn't appear in place");
+                static_assert(Error != graphsqlcheck::badReturn, "graphsql: malformed return sentence");
+                static_assert(Error != graphsqlcheck::unknownName,
+                            "graphsql: only node or edge id could appear in return sentence");
+                static_assert(Error != graphsqlcheck::badAggregate, "graphsql: malformed aggregate");
+                static_assert(Error != graphsqlcheck::badLimit, "graphsql: limit must be a non-negative integer");
+                static_assert(Error != graphsqlcheck::trailing, "graphsql: unexpected token at the end");
+                static_assert(Error != graphsqlcheck::badPath,
+                            "graphsql: shortestPath takes (a)-[p*]->(b) or (a)<-[p*]-(b) and an edge field");
+
+                static const GraphSqlSentence& sentence(const char* s, std::size_t size)
+                {
+                    return operator""_graphsql(s, size);
+                }
+            };
+    }
+}
+
+// text must be a string literal
+#define GRAPHSQL(text) \
+    (::netalgo::impl::StaticGraphSql< ::netalgo::impl::checkGraphSql(text) >::sentence(text, sizeof(text) - 1))
+
+#endif
@@ -8,6 +8,7 @@
 #include <cassert>
 #include <utility>
 #include <cstdlib>
+#include <vector>
 #include "graphdsl.hpp"
 #include "utility.hpp"
 
@@ -199,7 +200,7 @@ namespace
         };
 
     //Compare given field of a protobuf object with a value
-    bool reflectedCompare(google::protobuf::Message *obj, const std::string& fieldName,
+    inline bool reflectedCompare(google::protobuf::Message *obj, const std::string& fieldName,
                 netalgo::Relationship relationship, const std::string& value)
         {
             using namespace google::protobuf;
@@ -274,4 +275,303 @@ namespace
         }
 }
 
+namespace netalgo
+{
+    namespace impl
+    {
+        template<netalgo::Relationship R>
+            struct relationshipCompare;
+
+        template<>
+            struct relationshipCompare<netalgo::Relationship::equal>
+            {
+                template<typename A, typename B>
+                    bool operator()(const A& v1, const B& v2) const { return v1 == v2; }
+            };
+
+        template<>
+            struct relationshipCompare<netalgo::Relationship::smaller>
+            {
+                template<typename A, typename B>
+                    bool operator()(const A& v1, const B& v2) const { return v1 < v2; }
+            };
+
+        template<>
+            struct relationshipCompare<netalgo::Relationship::greater>
+            {
+                template<typename A, typename B>
+                    bool operator()(const A& v1, const B& v2) const { return v1 > v2; }
+            };
+
+        //Properties resolved against the message type T once, so that testing a message
+        //needs neither a field lookup nor parsing of the literal. Every property keeps its
+        //FieldDescriptor, the parsed constant and a comparison instantiated for the field
+        //type and relationship. id goes through the generated id() accessor when T has one.
+        //Gives the same answers as calling reflectedCompare on each property.
+        template<typename T>
+            class CompiledProperties
+            {
+                private:
+                    struct Predicate;
+                    typedef bool (*Evaluator)(const Predicate&, const T&);
+                    struct Predicate
+                    {
+                        const google::protobuf::FieldDescriptor* fdp;
+                        const google::protobuf::Reflection* reflection;
+                        google::protobuf::int64 intValue;
+                        google::protobuf::uint64 uintValue;
+                        double doubleValue;
+                        bool boolValue;
+                        std::string stringValue;
+                        Evaluator evaluate;
+                    };
+                    std::vector<Predicate> predicates_;
+
+                    // narrower field types are widened together with their literal,
+                    // which was parsed as the narrow type, so comparisons are unchanged
+                    struct BoolField
+                    {
+                        static bool get(const T& val, const Predicate& p, std::string*)
+                        { return p.reflection->GetBool(val, p.fdp); }
+                        static bool literal(const Predicate& p) { return p.boolValue; }
+                    };
+                    struct DoubleField
+                    {
+                        static double get(const T& val, const Predicate& p, std::string*)
+                        { return p.reflection->GetDouble(val, p.fdp); }
+                        static double literal(const Predicate& p) { return p.doubleValue; }
+                    };
+                    struct FloatField
+                    {
+                        static double get(const T& val, const Predicate& p, std::string*)
+                        { return p.reflection->GetFloat(val, p.fdp); }
+                        static double literal(const Predicate& p) { return p.doubleValue; }
+                    };
+                    struct Int32Field
+                    {
+                        static google::protobuf::int64 get(const T& val, const Predicate& p, std::string*)
+                        { return p.reflection->GetInt32(val, p.fdp); }
+                        static google::protobuf::int64 literal(const Predicate& p) { return p.intValue; }
+                    };
+                    struct Int64Field
+                    {
+                        static google::protobuf::int64 get(const T& val, const Predicate& p, std::string*)
+                        { return p.reflection->GetInt64(val, p.fdp); }
+                        static google::protobuf::int64 literal(const Predicate& p) { return p.intValue; }
+                    };
+                    struct UInt32Field
+                    {
+                        static google::protobuf::uint64 get(const T& val, const Predicate& p, std::string*)
+                        { return p.reflection->GetUInt32(val, p.fdp); }
+                        static google::protobuf::uint64 literal(const Predicate& p) { return p.uintValue; }
+                    };
+                    struct UInt64Field
+                    {
+                        static google::protobuf::uint64 get(const T& val, const Predicate& p, std::string*)
+                        { return p.reflection->GetUInt64(val, p.fdp); }
+                        static google::protobuf::uint64 literal(const Predicate& p) { return p.uintValue; }
+                    };
+                    struct StringField
+                    {
+                        static const std::string& get(const T& val, const Predicate& p, std::string* scratch)
+                        { return p.reflection->GetStringReference(val, p.fdp, scratch); }
+                        static const std::string& literal(const Predicate& p) { return p.stringValue; }
+                    };
+                    template<typename U>
+                    struct IdField
+                    {
+                        static const std::string& get(const U& val, const Predicate&, std::string*)
+                        { return val.id(); }
+                        static const std::string& literal(const Predicate& p) { return p.stringValue; }
+                    };
+
+                    template<typename Field, netalgo::Relationship R>
+                        static bool evaluate(const Predicate& p, const T& val)
+                        {
+                            std::string scratch;
+                            return relationshipCompare<R>()(Field::get(val, p, &scratch), Field::literal(p));
+                        }
+
+                    template<typename Field>
+                        static Evaluator select(netalgo::Relationship relationship)
+                        {
+                            switch(relationship)
+                            {
+                                case netalgo::Relationship::equal:
+                                return &evaluate<Field, netalgo::Relationship::equal>;
+                                case netalgo::Relationship::smaller:
+                                return &evaluate<Field, netalgo::Relationship::smaller>;
+                                case netalgo::Relationship::greater:
+                                return &evaluate<Field, netalgo::Relationship::greater>;
+                                default:
+                                throw std::runtime_error("Relationship unknown when comparing values");
+                            }
+                        }
+
+                    template<typename U>
+                        static auto idEvaluator(netalgo::Relationship relationship, const int)
+                        -> typename std::enable_if<std::is_same<
+                        typename std::decay<decltype(std::declval<const U&>().id())>::type,
+                        std::string>::value, Evaluator>::type
+                        {
+                            return select< IdField<U> >(relationship);
+                        }
+
+                    template<typename U>
+                        static Evaluator idEvaluator(netalgo::Relationship, const bool)
+                        {
+                            return nullptr;
+                        }
+
+                    static Predicate compile(const netalgo::Property& prop)
+                    {
+                        using namespace google::protobuf;
+                        Predicate p;
+                        p.fdp = T::descriptor()->FindFieldByName(prop.name);
+                        if (p.fdp == nullptr)
+                            throw std::runtime_error("Unknown field " + prop.name + " in query");
+                        if (p.fdp->is_repeated())
+                            throw std::runtime_error("Cannot compare repeated field " + prop.name);
+                        p.reflection = T::default_instance().GetReflection();
+                        switch(p.fdp->cpp_type())
+                        {
+                            case FieldDescriptor::CPPTYPE_BOOL:
+                            p.boolValue = from_string<bool>()(prop.value);
+                            p.evaluate = select<BoolField>(prop.relationship);
+                            break;
+
+                            case FieldDescriptor::CPPTYPE_DOUBLE:
+                            p.doubleValue = from_string<double>()(prop.value);
+                            p.evaluate = select<DoubleField>(prop.relationship);
+                            break;
+
+                            case FieldDescriptor::CPPTYPE_FLOAT:
+                            p.doubleValue = from_string<float>()(prop.value);
+                            p.evaluate = select<FloatField>(prop.relationship);
+                            break;
+
+                            case FieldDescriptor::CPPTYPE_INT32:
+                            p.intValue = from_string<int32>()(prop.value);
+                            p.evaluate = select<Int32Field>(prop.relationship);
+                            break;
+
+                            case FieldDescriptor::CPPTYPE_INT64:
+                            p.intValue = from_string<int64>()(prop.value);
+                            p.evaluate = select<Int64Field>(prop.relationship);
+                            break;
+
+                            case FieldDescriptor::CPPTYPE_UINT32:
+                            p.uintValue = from_string<uint32>()(prop.value);
+                            p.evaluate = select<UInt32Field>(prop.relationship);
+                            break;
+
+                            case FieldDescriptor::CPPTYPE_UINT64:
+                            p.uintValue = from_string<uint64>()(prop.value);
+                            p.evaluate = select<UInt64Field>(prop.relationship);
+                            break;
+
+                            case FieldDescriptor::CPPTYPE_STRING:
+                            p.stringValue = from_string<std::string>()(prop.value);
+                            p.evaluate = nullptr;
+                            if (prop.name == "id")
+                                p.evaluate = idEvaluator<T>(prop.relationship, 1);
+                            if (p.evaluate == nullptr)
+                                p.evaluate = select<StringField>(prop.relationship);
+                            break;
+
+                            case FieldDescriptor::CPPTYPE_MESSAGE:
+                            throw std::runtime_error(
+                                        std::string(
+                                            "Currently the library doesn't support reflection on message type"
+                                            )
+                                        );
+
+                            default:
+                            throw std::runtime_error(
+                                        std::string(
+                                            "unknown message type in reflection"
+                                            )
+                                        );
+                        }
+                        return p;
+                    }
+
+                public:
+                    CompiledProperties() = default;
+                    explicit CompiledProperties(const netalgo::Properties& props)
+                    {
+                        predicates_.reserve(props.size());
+                        for (const netalgo::Property& prop : props)
+                            predicates_.push_back(compile(prop));
+                    }
+
+                    bool empty() const
+                    {
+                        return predicates_.empty();
+                    }
+
+                    bool operator()(const T& val) const
+                    {
+                        for (const Predicate& p : predicates_)
+                            if (!p.evaluate(p, val))
+                                return false;
+                        return true;
+                    }
+            };
+
+        //A numeric field of T resolved once, read as a double. Used by aggregates,
+        //which only need this one field of each message.
+        template<typename T>
+            class NumericField
+            {
+                private:
+                    const google::protobuf::FieldDescriptor* fdp_;
+                    const google::protobuf::Reflection* reflection_;
+                public:
+                    explicit NumericField(const std::string& name)
+                    {
+                        using namespace google::protobuf;
+                        fdp_ = T::descriptor()->FindFieldByName(name);
+                        if (fdp_ == nullptr)
+                            throw std::runtime_error("Unknown field " + name + " in query");
+                        if (fdp_->is_repeated())
+                            throw std::runtime_error("Cannot aggregate repeated field " + name);
+                        switch(fdp_->cpp_type())
+                        {
+                            case FieldDescriptor::CPPTYPE_DOUBLE:
+                            case FieldDescriptor::CPPTYPE_FLOAT:
+                            case FieldDescriptor::CPPTYPE_INT32:
+                            case FieldDescriptor::CPPTYPE_INT64:
+                            case FieldDescriptor::CPPTYPE_UINT32:
+                            case FieldDescriptor::CPPTYPE_UINT64:
+                            break;
+                            default:
+                            throw std::runtime_error("Cannot aggregate non-numeric field " + name);
+                        }
+                        reflection_ = T::default_instance().GetReflection();
+                    }
+
+                    double operator()(const T& val) const
+                    {
+                        using namespace google::protobuf;
+                        switch(fdp_->cpp_type())
+                        {
+                            case FieldDescriptor::CPPTYPE_DOUBLE:
+                            return reflection_->GetDouble(val, fdp_);
+                            case FieldDescriptor::CPPTYPE_FLOAT:
+                            return reflection_->GetFloat(val, fdp_);
+                            case FieldDescriptor::CPPTYPE_INT32:
+                            return reflection_->GetInt32(val, fdp_);
+                            case FieldDescriptor::CPPTYPE_INT64:
+                            return static_cast<double>(reflection_->GetInt64(val, fdp_));
+                            case FieldDescriptor::CPPTYPE_UINT32:
+                            return reflection_->GetUInt32(val, fdp_);
+                            default:
+                            return static_cast<double>(reflection_->GetUInt64(val, fdp_));
+                        }
+                    }
+            };
+    }
+}
+
 #endif
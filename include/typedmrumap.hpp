@@ -148,6 +148,24 @@ namespace netalgo
                         return map_.end();
                     }
 
+                    size_type erase(const KeyT& key)
+                    {
+                        auto result = lastUsedTime_.find(key);
+                        if (result == lastUsedTime_.end())
+                            return 0;
+                        lastUsedTimeRev_.erase(result->second);
+                        lastUsedTime_.erase(result);
+                        return map_.erase(key);
+                    }
+
+                    void clear()
+                    {
+                        map_.clear();
+                        lastUsedTime_.clear();
+                        lastUsedTimeRev_.clear();
+                        objectSize = 0;
+                    }
+
                     size_type size() const
                     {
                         return map_.size();
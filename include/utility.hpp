@@ -15,7 +15,7 @@ namespace
             return C;
         }
 
-    std::string strLower(std::string s)
+    inline std::string strLower(std::string s)
     {
         for(char& c: s)
             c = std::tolower(c);
@@ -4,11 +4,13 @@
 #include <sstream>
 #include <iostream>
 #include <string>
-#include <deque>
 #include <cstring>
 #include <cctype>
 #include <functional>
 #include <unordered_map>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <algorithm>
 #include <cassert>
 
@@ -16,12 +18,9 @@ namespace HIDDEN
 {
     using namespace netalgo;
     using namespace std;
-    static const size_t BUFLEN=300;
     static const size_t CONTEXT_LEN=30;
     static const size_t LOOKBACKWARD_LEN = 10;
 
-    static const char chareof = static_cast<char>(char_traits<char>::eof());
-
     class NodeNotFoundException : GraphSqlParseException
     {
         public:
@@ -38,24 +37,96 @@ namespace HIDDEN
 
     GraphSqlSentence parseGraphSqlImpl(const char* s);
 
+    //Parsed sentences keyed by their text, at most capacity of them. Parsing
+    //happens outside the lock, two threads may parse the same new text at once.
     class GraphSqlManager
     {
         private:
-            static unordered_map<const char*, GraphSqlSentence> cache;
+            static const size_t capacity = 1024;
+            typedef list< pair<string, shared_ptr<const GraphSqlSentence> > > lruType;
+            mutex lock;
+            lruType lru; //most recently used first
+            unordered_map<string, lruType::iterator> cache;
+            //sentences of string literals, which live as long as the program
+            unordered_map<const char*, shared_ptr<const GraphSqlSentence> > literals;
+
+            static GraphSqlManager& instance()
+            {
+                static GraphSqlManager manager;
+                return manager;
+            }
         public:
-            static GraphSqlSentence& getParsedSentence(const char* p)
+            static shared_ptr<const GraphSqlSentence> getParsedSentence(const string& s)
+            {
+                GraphSqlManager& m = instance();
+                {
+                    lock_guard<mutex> guard(m.lock);
+                    auto it = m.cache.find(s);
+                    if (it != m.cache.end())
+                    {
+                        m.lru.splice(m.lru.begin(), m.lru, it->second);
+                        return it->second->second;
+                    }
+                }
+                auto parsed = make_shared<const GraphSqlSentence>(parseGraphSqlImpl(s.c_str()));
+                lock_guard<mutex> guard(m.lock);
+                if (m.cache.find(s) == m.cache.end())
+                {
+                    m.lru.emplace_front(s, parsed);
+                    m.cache.emplace(s, m.lru.begin());
+                    if (m.lru.size() > capacity)
+                    {
+                        m.cache.erase(m.lru.back().first);
+                        m.lru.pop_back();
+                    }
+                }
+                return parsed;
+            }
+
+            static const GraphSqlSentence& getLiteralSentence(const char* p)
             {
-                if (cache.find(p)==cache.end())
-                  cache.insert(make_pair(p, parseGraphSqlImpl(p)));
-                return cache[p];
+                GraphSqlManager& m = instance();
+                {
+                    lock_guard<mutex> guard(m.lock);
+                    auto it = m.literals.find(p);
+                    if (it != m.literals.end())
+                        return *it->second;
+                }
+                auto parsed = getParsedSentence(p);
+                lock_guard<mutex> guard(m.lock);
+                return *m.literals.emplace(p, parsed).first->second;
             }
     };
-    unordered_map<const char*, GraphSqlSentence> GraphSqlManager::cache;
 
     //Implementation of parser
-    //in small letters
+    //in small letters; limit, group, by, distinct and shortestPath are words only where
+    //they are expected, so they remain usable as names
     const char* KEYWORD_TABLE[] = { "select", "return" };
 
+    //A piece of the sentence being parsed, which it does not own
+    struct textView
+    {
+        const char* data;
+        size_t size;
+        textView(): data(""), size(0) {}
+        textView(const char* d, size_t s): data(d), size(s) {}
+        textView(const char* s): data(s), size(strlen(s)) {}
+        char operator[](size_t i) const { return data[i]; }
+        bool operator==(const textView& other) const
+        {
+            return size == other.size && memcmp(data, other.data, size) == 0;
+        }
+        //word must be in small letters
+        bool equalsLower(const char* word) const
+        {
+            for (size_t i = 0; i < size; ++i, ++word)
+                if (*word == '\0' || tolower(static_cast<unsigned char>(data[i])) != *word)
+                    return false;
+            return *word == '\0';
+        }
+        string str() const { return string(data, size); }
+    };
+
     struct token
     {
         enum TokenType
@@ -73,9 +144,13 @@ namespace HIDDEN
             rightparen, //)
             comma, //,
             eof,
-            string //"dsfa"
+            string, //"dsfa"
+            star, //*
+            dot, //.
+            parameter, //$abc
+            range //..
         } type;
-        std::string raw;
+        textView raw; //as written, keywords in small letters
         bool operator==(const token& other) const
         {
             return type == other.type && raw == other.raw;
@@ -85,72 +160,180 @@ namespace HIDDEN
             return !operator ==(other);
         }
         token() {}
-        token(const TokenType& t, const std::string s): type(t), raw(std::move(s)) {}
+        token(const TokenType& t, textView s): type(t), raw(s) {}
         friend ostream& operator<<(ostream&, const token&);
     };
     ostream& operator<<(ostream& o, const token& t)
     {
-        return o<<t.type<<" "<<t.raw;
+        return o<<t.type<<" "<<t.raw.str();
     }
 
-    //helpers of parser
-    istream& eatWhite(istream& is)
+    //Splits a sentence into tokens pointing into it, without copying
+    class lexer
     {
-        while (!is.eof())
-        {
-            char c = is.get();
-            if (!std::isspace(c))
+        private:
+            const char* begin_;
+            const char* end_;
+            const char* p_;
+
+            char peek(size_t k = 0) const
             {
-              is.unget();
-              return is;
+                return p_ + k < end_ ? p_[k] : '\0';
             }
-        }
-        return is;
-    }
 
-    //Support +1.21
-    //Not supported: 1.7e10
-    string getNumber(istream& is)
-    {
-        string result;
-        bool hasdot = false;
-        while(char c = is.get())
-        {
-            if (c!='-' && c!='+') { is.unget(); break; }
-            result.push_back(c);
-        }
-        while (char c = is.get())
-        {
-            if (!isdigit(c) && c!='.') { is.unget(); break; }
-            if (c=='.')
+            //the characters around p_, as GraphSqlParseStateException reads them from a stream
+            GraphSqlParseStateException error(const char* inf) const
             {
-                if (hasdot)
-                  throw GraphSqlParseException("You have more than one dot in number");
-                else
-                  hasdot = true;
+                const char* from = p_ - min<size_t>(p_ - begin_, LOOKBACKWARD_LEN);
+                return GraphSqlParseStateException(inf,
+                            string(from, min<size_t>(end_ - from, CONTEXT_LEN)));
             }
-            result.push_back(c);
-        }
-        return result;
-    }
 
-    string getIdentifier(istream& is)
+            //Support +1.21
+            //Not supported: 1.7e10
+            token number(const char* start)
+            {
+                bool hasdot = false;
+                while (peek() == '-' || peek() == '+')
+                    ++p_;
+                //1..3 is a range, not a number with two dots
+                for (; isdigit(static_cast<unsigned char>(peek())) || (peek() == '.' && peek(1) != '.'); ++p_)
+                    if (peek() == '.')
+                    {
+                        if (hasdot)
+                            throw GraphSqlParseException("You have more than one dot in number");
+                        hasdot = true;
+                    }
+                return {token::number, textView(start, p_ - start)};
+            }
+
+            textView identifierAt(const char* start)
+            {
+                char lookahead = peek();
+                ++p_;
+                if (!isalpha(static_cast<unsigned char>(lookahead)) && lookahead != ':' && lookahead != '_')
+                    throw error("The first character of identifier should be a letter or : or _");
+                while (isalnum(static_cast<unsigned char>(peek())) || peek() == '_')
+                    ++p_;
+                return textView(start, p_ - start);
+            }
+
+        public:
+            lexer(const char* s, size_t size): begin_(s), end_(s + size), p_(s) {}
+
+            token next()
+            {
+                while (p_ < end_ && isspace(static_cast<unsigned char>(*p_)))
+                    ++p_;
+                const char* start = p_;
+                if (p_ == end_)
+                    return {token::eof, textView()};
+                char lookahead = *p_++;
+                switch(lookahead)
+                {
+                    case '-':
+                        {
+                            char c = peek();
+                            if (!isdigit(static_cast<unsigned char>(c)) && c!='.' && c!='+')
+                                return {token::dash, textView(start, 1)};
+                            --p_;
+                            return number(start);
+                        }
+                    case '+':
+                        --p_;
+                        return number(start);
+                    case '[':
+                        return {token::leftbracket, textView(start, 1)};
+                    case ']':
+                        return {token::rightbracket, textView(start, 1)};
+                    case '<':
+                        return {token::smaller, textView(start, 1)};
+                    case '>':
+                        return {token::greater, textView(start, 1)};
+                    case '=':
+                        return {token::equal, textView(start, 1)};
+                    case '(':
+                        return {token::leftparen, textView(start, 1)};
+                    case ')':
+                        return {token::rightparen, textView(start, 1)};
+                    case ',':
+                        return {token::comma, textView(start, 1)};
+                    case '*':
+                        return {token::star, textView(start, 1)};
+                    case '.':
+                        if (peek() == '.')
+                        {
+                            ++p_;
+                            return {token::range, textView(start, 2)};
+                        }
+                        --p_;
+                        if (isdigit(static_cast<unsigned char>(peek(1))))
+                            return number(start);
+                        ++p_;
+                        return {token::dot, textView(start, 1)};
+                    case '$':
+                        identifierAt(p_);
+                        return {token::parameter, textView(start, p_ - start)};
+                    case '"':
+                        //escapes stay in raw, see constantValue
+                        while (p_ < end_ && *p_ != '"')
+                            p_ += *p_ == '\\' ? 2 : 1;
+                        if (p_ >= end_)
+                        {
+                            p_ = end_;
+                            throw error("Non-terminate string");
+                        }
+                        ++p_;
+                        return {token::string, textView(start, p_ - start)};
+                    default:
+                        --p_;
+                        if (isdigit(static_cast<unsigned char>(lookahead)))
+                            return number(start);
+                        textView identifier = identifierAt(start);
+                        for(size_t i = 0; i < arrayLen(KEYWORD_TABLE); ++i)
+                            if (identifier.equalsLower(KEYWORD_TABLE[i]))
+                                return {token::keyword, KEYWORD_TABLE[i]};
+                        return {token::identifier, identifier};
+                }
+            }
+    };
+
+    //The tokens of a sentence, read from the front. Past the last token
+    //front() is an eof token.
+    class tokenList
     {
-        char lookahead = is.get();
-        if (!isalpha(lookahead) && lookahead!=':' && lookahead!='_')
-          throw GraphSqlParseStateException("The first character of identifier should be a letter or : or _", is);
-        string result; result.push_back(lookahead);
-        while (char c = is.get())
-        {
-            if (!isalnum(c) && c!='_')
+        private:
+            vector<token> tokens_;
+            size_t pos_ = 0;
+        public:
+            tokenList(const char* s, size_t size)
             {
-                is.unget();
-                break;
+                lexer lx(s, size);
+                tokens_.reserve(size / 2 + 1);
+                for (token t = lx.next(); ; t = lx.next())
+                {
+                    tokens_.push_back(t);
+                    if (t.type == token::eof)
+                        break;
+                }
             }
-            result.push_back(c);
-        }
-        return result;
-    }
+            bool empty() const { return pos_ + 1 == tokens_.size(); }
+            size_t size() const { return tokens_.size() - pos_ - 1; }
+            const token& front() const { return tokens_[pos_]; }
+            const token& operator[](size_t i) const { return tokens_[min(pos_ + i, tokens_.size() - 1)]; }
+            void pop_front()
+            {
+                if (!empty())
+                    ++pos_;
+            }
+            //puts back the token just taken
+            void push_front(const token& t)
+            {
+                assert(pos_ > 0 && tokens_[pos_ - 1] == t);
+                (void)(t);
+                --pos_;
+            }
+    };
 
     bool isLogicalOp(const token& t)
     {
@@ -159,101 +342,35 @@ namespace HIDDEN
 
     bool isConstant(const token& t)
     {
-        return t.type == token::number || t.type==token::string;
+        return t.type == token::number || t.type==token::string || t.type == token::parameter;
     }
 
-    token getToken(istream& is)
+    //the constant as it is kept in Property::value, strings keep their quotes
+    string constantValue(const token& t)
     {
-        eatWhite(is);
-        char lookahead = is.get();
-        switch(lookahead)
+        if (t.type != token::string)
+            return t.raw.str();
+        string result;
+        result.reserve(t.raw.size);
+        for (size_t i = 0; i < t.raw.size; ++i)
         {
-            case '-':
-                {
-                    char c = is.peek();
-                    if (!isdigit(c) && c!='.' && c!='+')
-                        return {token::dash, "-"};
-                    else
-                    {
-                        is.unget();
-                        return {token::number, getNumber(is)};
-                    }
-                    break;
-                }
-            case '+':
-                return {token::number, getNumber(is)};
-                break;
-            case '[':
-                return {token::leftbracket, "["};
-                break;
-            case ']':
-                return {token::rightbracket, "]"};
-                break;
-            case '<':
-                return {token::smaller, "<"};
-                break;
-            case '>':
-                return {token::greater, ">"};
-                break;
-            case '=':
-                return {token::equal, "="};
-                break;
-            case '(':
-                return {token::leftparen, "("};
-                break;
-            case ')':
-                return {token::rightparen, ")"};
-                break;
-            case ',':
-                return {token::comma, ","};
-                break;
-            case chareof:
-                return {token::eof, string(1, chareof)};
-                break;
-            case '"':
-                {
-                    string tmp("\"");
-                    while (!is.eof())
-                    {
-                        char c = is.get();
-                        if (c=='\\')
-                            if (!is.eof())
-                                tmp.push_back(is.get());
-                            else
-                                throw GraphSqlParseStateException("Non-terminate string", is);
-                        else
-                        {
-                            tmp.push_back(c);
-                            if (c=='"') break;
-                        }
-                    }
-                    return {token::string, tmp};
-                    break;
-                }
-            default:
-                is.unget();
-                if (lookahead == '+' || lookahead == '-' || isdigit(lookahead))
-                    return {token::number, getNumber(is)};
-                string identifier = getIdentifier(is);
-                for(size_t i = 0; i < arrayLen(KEYWORD_TABLE); ++i)
-                    if (strLower(identifier) == KEYWORD_TABLE[i])
-                        return {token::keyword, KEYWORD_TABLE[i]};
-                return {token::identifier, identifier};
-
-        };
-        throw GraphSqlParseStateException("Cannot determine the type of token", is);
+            if (t.raw[i] == '\\')
+                ++i;
+            result.push_back(t.raw[i]);
+        }
+        return result;
     }
 
-    Property getProperty(deque<token> &tokenQueue)
+    Property getProperty(tokenList &tokenQueue)
     {
         if (tokenQueue.front().type != token::identifier)
-          throw GraphSqlParseStateException("the property name must be an identifier", tokenQueue.front().raw);
+          throw GraphSqlParseStateException("the property name must be an identifier", tokenQueue.front().raw.str());
         Property prop;
-        prop.name = tokenQueue.front().raw;
+        prop.name = tokenQueue.front().raw.str();
         tokenQueue.pop_front();
 
         if (tokenQueue.empty() || !isLogicalOp(tokenQueue.front()))
-          throw GraphSqlParseStateException("logical op(<,=,>) not found when parsing property", tokenQueue.empty() ? "eof" : tokenQueue.front().raw);
+          throw GraphSqlParseStateException("logical op(<,=,>) not found when parsing property", tokenQueue.empty() ? "eof" : tokenQueue.front().raw.str());
         switch(tokenQueue.front().type)
         {
             case token::smaller:
@@ -266,20 +383,20 @@ namespace HIDDEN
                 prop.relationship = Relationship::greater;
                 break;
             default:
-                throw GraphSqlParseStateException("Unexpected logical operator", tokenQueue.front().raw);
+                throw GraphSqlParseStateException("Unexpected logical operator", tokenQueue.front().raw.str());
         }
         tokenQueue.pop_front();
 
         if (tokenQueue.empty() || !isConstant(tokenQueue.front()))
           throw GraphSqlParseStateException("constant not found after logical op",
-                      tokenQueue.empty() ? "eof" : tokenQueue.front().raw);
-        prop.value = tokenQueue.front().raw;
+                      tokenQueue.empty() ? "eof" : tokenQueue.front().raw.str());
+        prop.value = constantValue(tokenQueue.front());
         tokenQueue.pop_front();
         return prop;
     }
 
     template<int Terminator>
-        vector<Property> getPropertyList(deque<token>& tokenQueue)
+        vector<Property> getPropertyList(tokenList& tokenQueue)
         {
             vector<Property> result;
             for(;;)
@@ -296,33 +413,48 @@ namespace HIDDEN
         }
 
     template<int C>
-        token getNextWithType(deque<token>& tokenQueue)
+        token getNextWithType(tokenList& tokenQueue)
         {
             if (tokenQueue.empty() || tokenQueue.front().type != C)
-              throw GraphSqlParseStateException("assert failure in next char", string("Expected: ")+char(C)+" Got:"+( tokenQueue.empty() ? "eof" : tokenQueue.front().raw));
+              throw GraphSqlParseStateException("assert failure in next char", string("Expected: ")+char(C)+" Got:"+( tokenQueue.empty() ? "eof" : tokenQueue.front().raw.str()));
             token t = tokenQueue.front();
             tokenQueue.pop_front();
             return t;
         }
 
-    std::string getId(deque<token> &tokenQueue)
+    std::string getId(tokenList &tokenQueue)
     {
         if (tokenQueue.empty() || tokenQueue.front().type != token::identifier)
           throw GraphSqlParseStateException("id not found",
-                      tokenQueue.empty() ? "EOF" : tokenQueue.front().raw);
+                      tokenQueue.empty() ? "EOF" : tokenQueue.front().raw.str());
         token first = tokenQueue.front();
-        string& lookahead = first.raw;
+        textView lookahead = first.raw;
         tokenQueue.pop_front();
 
         if (lookahead[0]!=':' && !isLogicalOp(tokenQueue.front()))
-          return lookahead;
+          return lookahead.str();
         else
           tokenQueue.push_front(first);
         return "";
     }
 
 
-    NodeType getNode(deque<token> &tokenQueue)
+    //:name after the id of a node, unless it is compared like a property
+    vector<string> getLabels(tokenList &tokenQueue)
+    {
+        vector<string> result;
+        while (tokenQueue.front().type == token::identifier && tokenQueue.front().raw[0] == ':' &&
+                    !isLogicalOp(tokenQueue[1]))
+        {
+            if (tokenQueue.front().raw.size == 1)
+                throw GraphSqlParseStateException("label name not found after :", tokenQueue[1].raw.str());
+            result.push_back(tokenQueue.front().raw.str().substr(1));
+            tokenQueue.pop_front();
+        }
+        return result;
+    }
+
+    NodeType getNode(tokenList &tokenQueue)
     {
         NodeType result;
         if (tokenQueue.front().type != token::leftparen)
@@ -336,12 +468,13 @@ namespace HIDDEN
         } else
         {
           result.id = getId(tokenQueue);
+          result.labels = getLabels(tokenQueue);
           result.properties = getPropertyList<token::rightparen>(tokenQueue);
         }
         return result;
     }
 
-    bool edgeTrailingDir(deque<token>& tokenQueue) //true on ->, false on -
+    bool edgeTrailingDir(tokenList& tokenQueue) //true on ->, false on -
     {
         getNextWithType<token::dash>(tokenQueue);
         if (tokenQueue.empty() || tokenQueue.front().type != token::greater)
@@ -351,7 +484,38 @@ namespace HIDDEN
         return true;
     }
 
-    EdgeType getEdge(deque<token>& tokenQueue)
+    size_t getHopCount(tokenList& tokenQueue)
+    {
+        string hops = getNextWithType<token::number>(tokenQueue).raw.str();
+        if (!std::all_of(hops.begin(), hops.end(), [](char c) { return isdigit(c); }))
+            throw GraphSqlParseStateException("hop count must be a non-negative integer", hops);
+        return std::stoull(hops);
+    }
+
+    //*, *N or *min..max, after [ or [name
+    void getHops(tokenList& tokenQueue, EdgeType& edge)
+    {
+        getNextWithType<token::star>(tokenQueue);
+        edge.variableLength = true;
+        if (tokenQueue.front().type == token::rightbracket)
+        {
+            tokenQueue.pop_front();
+            edge.maxHops = noLimit;
+            return;
+        }
+        edge.minHops = edge.maxHops = getHopCount(tokenQueue);
+        if (tokenQueue.front().type == token::range)
+        {
+            tokenQueue.pop_front();
+            edge.maxHops = getHopCount(tokenQueue);
+        }
+        if (edge.maxHops == 0 || edge.minHops > edge.maxHops)
+            throw GraphSqlParseStateException("hops must be *N or *min..max with 0 < max and min <= max",
+                        tokenQueue.front().raw.str());
+        getNextWithType<token::rightbracket>(tokenQueue);
+    }
+
+    EdgeType getEdge(tokenList& tokenQueue)
     {
         EdgeType result;
         bool leftDir = false, rightDir = false;
@@ -384,10 +548,15 @@ namespace HIDDEN
             {
                 result.id = "";
                 tokenQueue.pop_front();
-            } else
+            } else if (tokenQueue.front().type == token::star)
+                getHops(tokenQueue, result);
+            else
             {
                 result.id = getId(tokenQueue);
-                result.properties = getPropertyList<token::rightbracket>(tokenQueue);
+                if (tokenQueue.front().type == token::star)
+                    getHops(tokenQueue, result);
+                else
+                    result.properties = getPropertyList<token::rightbracket>(tokenQueue);
             }
             rightDir = edgeTrailingDir(tokenQueue);
 
@@ -418,29 +587,114 @@ namespace HIDDEN
         return false;
     }
 
+    bool isWord(const tokenList& tokenQueue, const char* word, size_t pos = 0)
+    {
+        return tokenQueue.size() > pos && tokenQueue[pos].type == token::identifier &&
+            tokenQueue[pos].raw.equalsLower(word);
+    }
+
+    //named and unbounded variable length edges describe the path of shortestPath,
+    //which is a single such edge between two nodes
+    void checkVariableLength(const SelectSentence& ss)
+    {
+        for (const auto& edge : ss.edges)
+            if (edge.variableLength && !ss.shortestPath && (edge.maxHops == noLimit || !edge.id.empty()))
+                throw GraphSqlParseStateException(
+                            "variable length edges outside shortestPath need *N or *min..max and no name",
+                            edge.id.empty() ? "*" : edge.id);
+        if (!ss.shortestPath)
+            return;
+        if (ss.edges.size() != 1 || !ss.edges[0].variableLength ||
+                    ss.edges[0].direction == EdgeDirection::bidirection || ss.edges[0].minHops > 1)
+            throw GraphSqlParseStateException("shortestPath takes (a)-[p*]->(b) or (a)<-[p*]-(b)",
+                        ss.edges.empty() ? ss.nodes[0].id : ss.edges[0].id);
+    }
+
+    string getReturnedName(tokenList& tokenQueue, const SelectSentence& ss)
+    {
+        string name = getNextWithType<token::identifier>(tokenQueue).raw.str();
+        if (!isValidIdentifier(ss, name))
+            throw GraphSqlParseStateException(
+                        "Only node or edge id could appear in return sentence",
+                        name);
+        return name;
+    }
+
+    //count(*), count(a), count(distinct a), sum(a.field), min(a.field), max(a.field), avg(a.field)
+    Aggregate getAggregate(tokenList& tokenQueue, const SelectSentence& ss)
+    {
+        static const pair<const char*, AggregateFunction> FIELD_FUNCTIONS[] = {
+            {"sum", AggregateFunction::sumOf}, {"min", AggregateFunction::minOf},
+            {"max", AggregateFunction::maxOf}, {"avg", AggregateFunction::avgOf} };
+        Aggregate result;
+        textView function = getNextWithType<token::identifier>(tokenQueue).raw;
+        getNextWithType<token::leftparen>(tokenQueue);
+        if (function.equalsLower("count"))
+        {
+            if (!tokenQueue.empty() && tokenQueue.front().type == token::star)
+            {
+                tokenQueue.pop_front();
+                result.function = AggregateFunction::countAll;
+            } else
+            {
+                result.function = AggregateFunction::countBound;
+                //distinct could be a name as well, count(distinct)
+                if (isWord(tokenQueue, "distinct") && tokenQueue.size() > 1 &&
+                            tokenQueue[1].type == token::identifier)
+                {
+                    tokenQueue.pop_front();
+                    result.function = AggregateFunction::countDistinct;
+                }
+                result.name = getReturnedName(tokenQueue, ss);
+            }
+        } else
+        {
+            auto f = find_if(begin(FIELD_FUNCTIONS), end(FIELD_FUNCTIONS),
+                        [&function](const pair<const char*, AggregateFunction>& p)
+                        { return function.equalsLower(p.first); });
+            if (f == end(FIELD_FUNCTIONS))
+                throw GraphSqlParseStateException("unknown aggregate function", function.str());
+            result.function = f->second;
+            result.name = getReturnedName(tokenQueue, ss);
+            getNextWithType<token::dot>(tokenQueue);
+            result.field = getNextWithType<token::identifier>(tokenQueue).raw.str();
+        }
+        getNextWithType<token::rightparen>(tokenQueue);
+        return result;
+    }
+
+    void getReturnItem(tokenList& tokenQueue, GraphSqlSentence& result)
+    {
+        if (tokenQueue.empty() || tokenQueue.front().type != token::identifier)
+            throw GraphSqlParseStateException(
+                        "only identifier could appear in return sentence",
+                        tokenQueue.empty() ? "eof" : tokenQueue.front().raw.str());
+        if (tokenQueue.size() > 1 && tokenQueue[1].type == token::leftparen)
+            result.second.aggregates.push_back(getAggregate(tokenQueue, result.first));
+        else
+            result.second.returnName.push_back(getReturnedName(tokenQueue, result.first));
+    }
+
     GraphSqlSentence parseGraphSqlImpl(const char* c)
     {
-        istringstream is(c);
-        deque<token> tokenQueue;
-        for(token t = getToken(is); t.type!=token::eof; t=getToken(is))
-            tokenQueue.push_back(t);
-#ifdef MYDEBUG
-        //int cnt = 0;
-        //for (auto &s:tokenQueue)
-        //{
-            //cout << cnt << "."<<s.raw<<" "<<s.type << endl;
-            //++cnt;
-        //}
-#endif
+        tokenList tokenQueue(c, strlen(c));
 
         GraphSqlSentence result;
 
         if (tokenQueue.front() != token( token::keyword, "select" ))
             throw GraphSqlParseStateException(
                         "the first token must be select",
-                        tokenQueue.front().raw);
+                        tokenQueue.front().raw.str());
         tokenQueue.pop_front();
 
+        //shortestPath(pattern) or shortestPath(pattern, weight)
+        if (isWord(tokenQueue, "shortestpath") && tokenQueue.size() > 1 &&
+                    tokenQueue[1].type == token::leftparen)
+        {
+            tokenQueue.pop_front();
+            tokenQueue.pop_front();
+            result.first.shortestPath = true;
+        }
         result.first.nodes.push_back(getNode(tokenQueue));
         for(;;)
         {
@@ -454,30 +708,77 @@ namespace HIDDEN
             }
             result.first.nodes.push_back(getNode(tokenQueue));
         }
+        if (result.first.shortestPath)
+        {
+            if (tokenQueue.front().type == token::comma)
+            {
+                tokenQueue.pop_front();
+                result.first.weight = getNextWithType<token::identifier>(tokenQueue).raw.str();
+            }
+            getNextWithType<token::rightparen>(tokenQueue);
+        }
+        checkVariableLength(result.first);
 
         if (tokenQueue.front() != token(token::keyword, "return"))
             throw GraphSqlParseStateException(
                         "return doesn't appear in place",
-                        tokenQueue.front().raw);
+                        tokenQueue.front().raw.str());
         tokenQueue.pop_front();
 
-        token first = tokenQueue.front();
-        if (first.type != token::identifier)
+        getReturnItem(tokenQueue, result);
+        while(!tokenQueue.empty() && tokenQueue.front().type == token::comma)
+        {
+            tokenQueue.pop_front();
+            getReturnItem(tokenQueue, result);
+        }
+
+        if (isWord(tokenQueue, "group") && isWord(tokenQueue, "by", 1))
+        {
+            tokenQueue.pop_front();
+            tokenQueue.pop_front();
+            vector<string> groupBy{getReturnedName(tokenQueue, result.first)};
+            while(!tokenQueue.empty() && tokenQueue.front().type == token::comma)
+            {
+                tokenQueue.pop_front();
+                groupBy.push_back(getReturnedName(tokenQueue, result.first));
+            }
+            if (result.second.aggregates.empty())
+                throw GraphSqlParseStateException(
+                            "group by needs an aggregate in return sentence", groupBy.front());
+            auto sorted = [](vector<string> v)
+            {
+                sort(v.begin(), v.end());
+                v.erase(unique(v.begin(), v.end()), v.end());
+                return v;
+            };
+            if (sorted(groupBy) != sorted(result.second.returnName))
+                throw GraphSqlParseStateException(
+                            "group by must list the returned names that are not aggregates",
+                            groupBy.front());
+        }
+
+        if (result.first.shortestPath && !result.second.aggregates.empty())
             throw GraphSqlParseStateException(
-                        "only identifier could appear in return sentence",
-                        first.raw);
-        result.second.returnName.push_back(first.raw);
-        tokenQueue.pop_front();
+                        "shortestPath cannot be aggregated", "shortestPath");
 
-        while(!tokenQueue.empty())
+        if (!tokenQueue.empty() && !isWord(tokenQueue, "limit"))
+            throw GraphSqlParseStateException(
+                        "unexpected token in return sentence",
+                        tokenQueue.front().raw.str());
+
+        if (!tokenQueue.empty())
         {
-            getNextWithType<token::comma>(tokenQueue);
-            result.second.returnName.push_back(getNextWithType<token::identifier>(tokenQueue).raw);
-            if (!isValidIdentifier(result.first,
-                            *result.second.returnName.rbegin()))
+            tokenQueue.pop_front();
+            string limit = getNextWithType<token::number>(tokenQueue).raw.str();
+            if (limit.empty() || !std::all_of(limit.begin(), limit.end(),
+                            [](char c) { return isdigit(c); }))
+                throw GraphSqlParseStateException(
+                            "limit must be a non-negative integer", limit);
+            result.second.limit = std::stoull(limit);
+            if (!tokenQueue.empty())
                 throw GraphSqlParseStateException(
-                            "Only node or edge id could appear in return sentence",
-                            *result.second.returnName.rbegin());
+                            "nothing could appear after limit",
+                            tokenQueue.front().raw.str());
         }
         return result;
     }
@@ -490,13 +791,13 @@ namespace netalgo
     GraphSqlParseException::GraphSqlParseException():GraphSqlParseException("") {}
 
     GraphSqlParseException::GraphSqlParseException(const char* inf):
-        info(new char[HIDDEN::BUFLEN])
+        info(new char[std::strlen(inf) + 1])
     {
         std::strcpy(info.get(), inf);
     }
 
     GraphSqlParseException::GraphSqlParseException(const GraphSqlParseException& other):
-        info(new char[HIDDEN::BUFLEN])
+        info(new char[std::strlen(other.info.get()) + 1])
     {
         std::strcpy(info.get(), other.info.get());
     }
@@ -515,10 +816,9 @@ namespace netalgo
     {
         std::istream::pos_type pos = state.tellg();
         state.seekg(-std::min(pos, std::streampos(HIDDEN::LOOKBACKWARD_LEN)), std::istream::cur);
-        char buffer[HIDDEN::BUFLEN];
-        state.read(buffer, HIDDEN::CONTEXT_LEN);
-        buffer[state.gcount()] = '\0';
-        nearbyChars = buffer;
+        nearbyChars.resize(HIDDEN::CONTEXT_LEN);
+        state.read(&nearbyChars[0], HIDDEN::CONTEXT_LEN);
+        nearbyChars.resize(state.gcount());
         state.seekg(pos, std::istream::beg);
     }
 
@@ -540,15 +840,55 @@ namespace netalgo
 
     //GraphSqlSentenceParse
 
-    const GraphSqlSentence& parseGraphSql(const char* s)
+    std::shared_ptr<const GraphSqlSentence> parseGraphSql(const std::string& s)
     {
         return HIDDEN::GraphSqlManager::getParsedSentence(s);
     }
 
+    //PreparedGraphSql
+    PreparedGraphSql::PreparedGraphSql(const std::string& s):
+        sentence_(parseGraphSql(s))
+    {
+        auto collect = [this](bool isNode, std::size_t element, const Properties& properties)
+        {
+            for (std::size_t i = 0; i < properties.size(); ++i)
+                if (!properties[i].value.empty() && properties[i].value[0] == '$')
+                    placeholders_.push_back({isNode, element, i, properties[i].value.substr(1)});
+        };
+        for (std::size_t i = 0; i < sentence_->first.nodes.size(); ++i)
+            collect(true, i, sentence_->first.nodes[i].properties);
+        for (std::size_t i = 0; i < sentence_->first.edges.size(); ++i)
+            collect(false, i, sentence_->first.edges[i].properties);
+    }
+
+    std::vector<std::string> PreparedGraphSql::parameters() const
+    {
+        std::vector<std::string> result;
+        for (const Placeholder& p : placeholders_)
+            if (std::find(result.begin(), result.end(), p.name) == result.end())
+                result.push_back(p.name);
+        return result;
+    }
+
+    GraphSqlSentence PreparedGraphSql::bind(const GraphSqlParameters& values) const
+    {
+        GraphSqlSentence result = *sentence_;
+        for (const Placeholder& p : placeholders_)
+        {
+            const std::string* value = values.find(p.name);
+            if (value == nullptr)
+                throw GraphSqlParseStateException("parameter is not bound", "$" + p.name);
+            Properties& properties = p.isNode ? result.first.nodes[p.element].properties :
+                result.first.edges[p.element].properties;
+            properties[p.property].value = *value;
+        }
+        return result;
+    }
+
 }
 
 const netalgo::GraphSqlSentence& operator""_graphsql(const char* s, size_t size)
 {
     assert(size == std::strlen(s));
-    return netalgo::parseGraphSql(s);
+    return HIDDEN::GraphSqlManager::getLiteralSentence(s);
 }
@@ -0,0 +1,42 @@
+#include "debug.hpp"
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include "graphdsl.cpp"
+using namespace std;
+
+//Sentences parsed per second, without the sentence cache.
+//usage: graphdslbench [seconds]
+
+static const char* corpus[] = {
+    "select (a) return a",
+    "select (a)-->(b) return a,b",
+    "select (id=\"A\")-[e]->(b) return e,b",
+    "select (a len>3)--(len=2) return a",
+    "select (a)-[e]->(b imp=2) return a,e,b",
+    "select (a imp<2)-[e]->(b)<-[f]-(c imp>1) return a,b,c,e,f",
+    "select (a id=\"n3\")-[e]->(b)-[f]->(c) return a,c,f",
+    "select (a)-[e id=\"e5\"]->(b)-[f]->(c id=\"n6\") return a,b,c",
+    "select (a)-[e1]->(m id=\"M\")<-[e2]-(c) return a,c",
+    "select (a id=\"hub\")-[e]->(b)-[f]->(c id=\"C\") return b",
+    "select (a id=$from)-[e]->(b imp>$min) return b limit 100",
+    "select (a)-[e]->(b) return a, count(distinct b), sum(b.imp), avg(b.imp) group by a",
+    "select (u :name=\"alice smith\" age>30)-[k since<2015.5]->(v :name=\"bob\")<-[l]-(w) return u,v,w,k,l"
+};
+
+int main(int argc, char** argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 3;
+    size_t parsed = 0, nodes = 0;
+    auto start = chrono::steady_clock::now();
+    double elapsed = 0;
+    while (elapsed < seconds)
+    {
+        for (const char* s : corpus)
+            nodes += HIDDEN::parseGraphSqlImpl(s).first.nodes.size();
+        parsed += arrayLen(corpus);
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    cout << parsed / elapsed << " sentences/s (" << parsed << " in " << elapsed << "s, "
+        << nodes << " nodes)" << endl;
+}
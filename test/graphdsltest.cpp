@@ -4,52 +4,57 @@
 #include <utility>
 #include <sstream>
 #include <chrono>
+#include <thread>
 #include "graphdsl.cpp"
+#include "graphdsl_static.hpp"
 using namespace std;
 
 TEST(GraphDSLTest, TokenTest1)
 {
-    istringstream is("(abc :abc)");
+    const char* s = "(abc :abc)";
     using namespace HIDDEN;
-    EXPECT_EQ(token( token::leftparen, "(" ), getToken(is));
-    EXPECT_EQ(token(token::identifier, "abc"), getToken(is));
-    EXPECT_EQ(token(token::identifier, ":abc"), getToken(is));
-    EXPECT_EQ(token(token::rightparen, ")"), getToken(is));
+    lexer lx(s, strlen(s));
+    EXPECT_EQ(token( token::leftparen, "(" ), lx.next());
+    EXPECT_EQ(token(token::identifier, "abc"), lx.next());
+    EXPECT_EQ(token(token::identifier, ":abc"), lx.next());
+    EXPECT_EQ(token(token::rightparen, ")"), lx.next());
 }
 
 TEST(GraphDSLTest, TokenTest2)
 {
-    istringstream is("(A_1 :person data>100)-[k len<-10]->(B)");
+    const char* s = "(A_1 :person data>100)-[k len<-10]->(B)";
     using namespace HIDDEN;
-    EXPECT_EQ(token( token::leftparen, "(" ), getToken(is));
-    EXPECT_EQ(token(token::identifier, "A_1"), getToken(is));
-    EXPECT_EQ(token(token::identifier, ":person"), getToken(is));
-    EXPECT_EQ(token(token::identifier, "data"), getToken(is));
-    EXPECT_EQ(token(token::greater, ">"), getToken(is));
-    EXPECT_EQ(token(token::number, "100"), getToken(is));
-    EXPECT_EQ(token(token::rightparen, ")"), getToken(is));
-    EXPECT_EQ(token(token::dash, "-"), getToken(is));
-    EXPECT_EQ(token(token::leftbracket, "["), getToken(is));
-    EXPECT_EQ(token(token::identifier, "k"), getToken(is));
-    EXPECT_EQ(token(token::identifier, "len"), getToken(is));
-    EXPECT_EQ(token(token::smaller, "<"), getToken(is));
-    EXPECT_EQ(token(token::number, "-10"), getToken(is));
-    EXPECT_EQ(token(token::rightbracket, "]"), getToken(is));
-    EXPECT_EQ(token(token::dash, "-"), getToken(is));
-    EXPECT_EQ(token(token::greater, ">"), getToken(is));
-    EXPECT_EQ(token(token::leftparen, "("), getToken(is));
-    EXPECT_EQ(token(token::identifier, "B"), getToken(is));
-    EXPECT_EQ(token(token::rightparen, ")"), getToken(is));
+    lexer lx(s, strlen(s));
+    EXPECT_EQ(token( token::leftparen, "(" ), lx.next());
+    EXPECT_EQ(token(token::identifier, "A_1"), lx.next());
+    EXPECT_EQ(token(token::identifier, ":person"), lx.next());
+    EXPECT_EQ(token(token::identifier, "data"), lx.next());
+    EXPECT_EQ(token(token::greater, ">"), lx.next());
+    EXPECT_EQ(token(token::number, "100"), lx.next());
+    EXPECT_EQ(token(token::rightparen, ")"), lx.next());
+    EXPECT_EQ(token(token::dash, "-"), lx.next());
+    EXPECT_EQ(token(token::leftbracket, "["), lx.next());
+    EXPECT_EQ(token(token::identifier, "k"), lx.next());
+    EXPECT_EQ(token(token::identifier, "len"), lx.next());
+    EXPECT_EQ(token(token::smaller, "<"), lx.next());
+    EXPECT_EQ(token(token::number, "-10"), lx.next());
+    EXPECT_EQ(token(token::rightbracket, "]"), lx.next());
+    EXPECT_EQ(token(token::dash, "-"), lx.next());
+    EXPECT_EQ(token(token::greater, ">"), lx.next());
+    EXPECT_EQ(token(token::leftparen, "("), lx.next());
+    EXPECT_EQ(token(token::identifier, "B"), lx.next());
+    EXPECT_EQ(token(token::rightparen, ")"), lx.next());
 }
 
 TEST(GraphDSLTest, InvalidTokenTest)
 {
-    istringstream is("a^b");
+    const char* s = "a^b";
     using namespace HIDDEN;
+    lexer lx(s, strlen(s));
     try
     {
-        getToken(is);
-        token t = getToken(is);
+        lx.next();
+        token t = lx.next();
     } catch(netalgo::GraphSqlParseStateException& e)
     {
         EXPECT_STREQ(e.what(), "The first character of identifier should be a letter or : or _");
@@ -58,6 +63,25 @@ TEST(GraphDSLTest, InvalidTokenTest)
     
 }
 
+TEST(GraphDSLTest, ConstantTest)
+{
+    using namespace netalgo;
+    const GraphSqlSentence& s = "select (a name=\"say \\\"hi\\\"\" len>+2 w<.5) return a"_graphsql;
+    const Properties& props = s.first.nodes[0].properties;
+    EXPECT_EQ("\"say \"hi\"\"", props[0].value);
+    EXPECT_EQ("+2", props[1].value);
+    EXPECT_EQ(".5", props[2].value);
+    EXPECT_THROW("select (a name=\"open) return a"_graphsql, GraphSqlParseStateException);
+    try
+    {
+        "select (a x=1) return a ^"_graphsql;
+        ADD_FAILURE();
+    } catch(GraphSqlParseStateException& e)
+    {
+        EXPECT_EQ("return a ^", e.getNearbyChars());
+    }
+}
+
 TEST(GraphDSLTest, SentenceTest1)
 {
     using namespace netalgo;
@@ -86,6 +110,278 @@ TEST(GraphDSLTest, SentenceTest1)
 
 }
 
+TEST(GraphDSLTest, LimitTest)
+{
+    using namespace netalgo;
+    EXPECT_EQ(noLimit, "select (a)-->(b) return a,b"_graphsql.second.limit);
+    const GraphSqlSentence& s = "select (a)-->(b) return a,b limit 10"_graphsql;
+    EXPECT_EQ(10ul, s.second.limit);
+    EXPECT_EQ(2ul, s.second.returnName.size());
+    EXPECT_EQ(0ul, "select (a) return a LIMIT 0"_graphsql.second.limit);
+
+    EXPECT_THROW("select (a) return a limit -1"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a) return a limit 1.5"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a) return a limit"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a) return a limit 3 a"_graphsql, GraphSqlParseException);
+
+    // limit is only a word after the return list
+    const GraphSqlSentence& named = "select (limit limit>1)-[by]->(b) return limit, by limit 2"_graphsql;
+    EXPECT_EQ("limit", named.first.nodes[0].id);
+    EXPECT_EQ("limit", named.first.nodes[0].properties[0].name);
+    EXPECT_EQ(2ul, named.second.returnName.size());
+    EXPECT_EQ(2ul, named.second.limit);
+    EXPECT_EQ(noLimit, "select (limit) return limit"_graphsql.second.limit);
+    EXPECT_THROW("select (limit) return limit limit"_graphsql, GraphSqlParseException);
+}
+
+TEST(GraphDSLTest, LabelTest)
+{
+    using namespace netalgo;
+    const GraphSqlSentence& s = "select (a:Paper:Journal year>2000)-->(:Author)-[e :x=1]->(b :y=2) return a"_graphsql;
+    const auto& nodes = s.first.nodes;
+    EXPECT_EQ("a", nodes[0].id);
+    EXPECT_EQ((vector<string>{"Paper", "Journal"}), nodes[0].labels);
+    EXPECT_EQ(1ul, nodes[0].properties.size());
+    EXPECT_EQ("", nodes[1].id);
+    EXPECT_EQ(vector<string>{"Author"}, nodes[1].labels);
+    // compared like a property, :y stays one
+    EXPECT_TRUE(nodes[2].labels.empty());
+    EXPECT_EQ(":y", nodes[2].properties[0].name);
+    EXPECT_EQ(":x", s.first.edges[1].properties[0].name);
+    EXPECT_THROW("select (a : ) return a"_graphsql, GraphSqlParseStateException);
+    EXPECT_THROW("select (a x=1 :Paper) return a"_graphsql, GraphSqlParseStateException);
+}
+
+TEST(GraphDSLTest, VariableLengthTest)
+{
+    using namespace netalgo;
+    const GraphSqlSentence& s = "select (a)-[*1..3]->(b)<-[* 2 ]-(c)-->(d) return a, b"_graphsql;
+    const auto& edges = s.first.edges;
+    EXPECT_TRUE(edges[0].variableLength);
+    EXPECT_EQ(EdgeDirection::next, edges[0].direction);
+    EXPECT_EQ(1ul, edges[0].minHops);
+    EXPECT_EQ(3ul, edges[0].maxHops);
+    EXPECT_TRUE(edges[1].variableLength);
+    EXPECT_EQ(EdgeDirection::prev, edges[1].direction);
+    EXPECT_EQ(2ul, edges[1].minHops);
+    EXPECT_EQ(2ul, edges[1].maxHops);
+    EXPECT_FALSE(edges[2].variableLength);
+    EXPECT_EQ(0ul, "select (a)-[*0..2]->(b) return b"_graphsql.first.edges[0].minHops);
+
+    EXPECT_THROW("select (a)-[*]->(b) return a"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a)-[*0]->(b) return a"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a)-[*3..1]->(b) return a"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a)-[*1.5]->(b) return a"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a)-[e*1..2]->(b) return a"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a)-[*1..2 len>3]->(b) return a"_graphsql, GraphSqlParseException);
+}
+
+TEST(GraphDSLTest, ShortestPathTest)
+{
+    using namespace netalgo;
+    const GraphSqlSentence& s = "select shortestPath((a id=\"A\")-[p*]->(b id=\"B\")) return p"_graphsql;
+    EXPECT_TRUE(s.first.shortestPath);
+    EXPECT_EQ("", s.first.weight);
+    EXPECT_EQ("p", s.first.edges[0].id);
+    EXPECT_EQ(EdgeDirection::next, s.first.edges[0].direction);
+    EXPECT_EQ(noLimit, s.first.edges[0].maxHops);
+    const GraphSqlSentence& w = "select SHORTESTPATH ((a)<-[p *1..4]-(b), len) return a, b"_graphsql;
+    EXPECT_TRUE(w.first.shortestPath);
+    EXPECT_EQ("len", w.first.weight);
+    EXPECT_EQ(EdgeDirection::prev, w.first.edges[0].direction);
+    EXPECT_EQ(4ul, w.first.edges[0].maxHops);
+    EXPECT_FALSE("select (a)-[*1..2]->(b) return a"_graphsql.first.shortestPath);
+
+    EXPECT_THROW("select shortestPath((a)-[p*]-(b)) return p"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select shortestPath((a)-[p]->(b)) return p"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select shortestPath((a)-[p*2..3]->(b)) return p"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select shortestPath((a)-[p*]->(b)-->(c)) return p"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select shortestPath((a)-[p*]->(b) return p"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select shortestPath((a)-[p*]->(b)) return count(*)"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a)-[p*]->(b) return p"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a)-[p*1..2]->(b) return p"_graphsql, GraphSqlParseException);
+}
+
+TEST(GraphDSLTest, AggregateTest)
+{
+    using namespace netalgo;
+    const ReturnSentence& all = "select (a)-[e]->(b) return count(*)"_graphsql.second;
+    EXPECT_TRUE(all.returnName.empty());
+    ASSERT_EQ(1ul, all.aggregates.size());
+    EXPECT_EQ(AggregateFunction::countAll, all.aggregates[0].function);
+
+    const ReturnSentence& grouped =
+        "select (a)-[e]->(b) return a, count(distinct b), SUM(b.imp), avg(b.imp) group by a limit 3"_graphsql.second;
+    EXPECT_EQ(vector<string>{"a"}, grouped.returnName);
+    ASSERT_EQ(3ul, grouped.aggregates.size());
+    EXPECT_EQ(AggregateFunction::countDistinct, grouped.aggregates[0].function);
+    EXPECT_EQ("b", grouped.aggregates[0].name);
+    EXPECT_EQ(AggregateFunction::sumOf, grouped.aggregates[1].function);
+    EXPECT_EQ("imp", grouped.aggregates[1].field);
+    EXPECT_EQ(AggregateFunction::avgOf, grouped.aggregates[2].function);
+    EXPECT_EQ(3ul, grouped.limit);
+
+    // distinct is an ordinary name unless another name follows it
+    const ReturnSentence& named = "select (distinct)-->(b) return count(distinct)"_graphsql.second;
+    EXPECT_EQ(AggregateFunction::countBound, named.aggregates[0].function);
+    EXPECT_EQ("distinct", named.aggregates[0].name);
+
+    EXPECT_THROW("select (a) return count(c)"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a) return sum(a)"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a) return median(a.imp)"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a)-->(b) return a, count(*) group by b"_graphsql, GraphSqlParseException);
+    EXPECT_THROW("select (a) return a group by a"_graphsql, GraphSqlParseException);
+}
+
+TEST(GraphDSLTest, PreparedTest)
+{
+    using namespace netalgo;
+    string text = "select (a id=$id)-[e len<$len]->(b id=$id) return b";
+    auto first = parseGraphSql(text);
+    // same text in another buffer
+    EXPECT_EQ(first, parseGraphSql(string(text.begin(), text.end())));
+    EXPECT_EQ("$id", first->first.nodes[0].properties[0].value);
+
+    PreparedGraphSql prepared(text);
+    EXPECT_EQ((vector<string>{"id", "len"}), prepared.parameters());
+    GraphSqlSentence bound = prepared.bind(GraphSqlParameters().set("id", "n1").set("len", 2.5));
+    EXPECT_EQ("\"n1\"", bound.first.nodes[0].properties[0].value);
+    EXPECT_EQ("2.5", bound.first.edges[0].properties[0].value);
+    EXPECT_EQ("\"n1\"", bound.first.nodes[1].properties[0].value);
+    EXPECT_EQ("$id", prepared.sentence().first.nodes[0].properties[0].value);
+    EXPECT_EQ("7", prepared.bind(GraphSqlParameters().set("id", "x").set("len", 7))
+                .first.edges[0].properties[0].value);
+    EXPECT_THROW(prepared.bind(GraphSqlParameters().set("id", "n1")), GraphSqlParseException);
+
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([]
+                    {
+                        for (int i = 0; i < 2000; ++i)
+                            parseGraphSql("select (a id=\"" + to_string(i % 1500) + "\") return a");
+                    });
+    for (auto& t : threads)
+        t.join();
+    EXPECT_EQ("\"7\"", parseGraphSql("select (a id=\"7\") return a")->first.nodes[0].properties[0].value);
+}
+
+TEST(GraphDSLTest, StaticCheckTest)
+{
+    using namespace netalgo;
+    using namespace netalgo::impl;
+    static_assert(checkGraphSql("select (a id=\"A\")-[e]->(b)<--(c len>3) return a, e LIMIT 5") == 0, "");
+    static_assert(checkGraphSql("select (a)-[e]->(b) return a, count(distinct b), sum(b.imp) group by a") == 0, "");
+    static_assert(checkGraphSql("sel (a) return a") == graphsqlcheck::noSelect, "");
+    static_assert(checkGraphSql("select (a)<-->(b) return a") == graphsqlcheck::badEdge, "");
+    static_assert(checkGraphSql("select (a)-->(b) return c") == graphsqlcheck::unknownName, "");
+    static_assert(checkGraphSql("select (a)-->(b) return a limit 1.5") == graphsqlcheck::badLimit, "");
+    static_assert(checkGraphSql("select (a)-[*1..3]->(b)<-[*2]-(c) return a, c") == 0, "");
+    static_assert(checkGraphSql("select (a)-[*3..1]->(b) return a") == graphsqlcheck::badEdge, "");
+    static_assert(checkGraphSql("select shortestPath((a id=\"A\")-[p*]->(b), len) return p, b") == 0, "");
+    static_assert(checkGraphSql("select shortestPath((a)-[p*]-(b)) return p") == graphsqlcheck::badPath, "");
+    static_assert(checkGraphSql("select (a:Paper)-->(:Author x>1) return a") == 0, "");
+    static_assert(checkGraphSql("select (a : ) return a") == graphsqlcheck::badNode, "");
+    EXPECT_EQ(&"select (a)-->(b) return a,b"_graphsql, &GRAPHSQL("select (a)-->(b) return a,b"));
+
+    // the check and the parser agree
+    const char* sentences[] = {
+        "select (a len>3)--(len=2) return a",
+        "select (a)-[e :x=\"\\\"\"]->(b) return e",
+        "select (a id=$id)-->() return a",
+        "select () return a",
+        "select (a) return a,",
+        "select (a) return a limit",
+        "select (a) return a limit 3 a",
+        "select (a) return count(*) group by a",
+        "select (a)-[e]->(b) return median(a.x)",
+        "select (a)-[e]->(b) return sum(a)",
+        "select (a)-(b) return a",
+        "select (a)-1(b) return a",
+        "select (a x>1.2.3) return a",
+        "select (a x>\"open) return a",
+        "select (select) return a",
+        "select (limit)-[limit]->(b) return b",
+        "select (limit) return limit limit 1",
+        "select (limit) return limit limit",
+        "select (a) return a, limit",
+        "select (a) return a #",
+        "select (a)->(b) return a",
+        "select (a)-[* 0 .. 2]->(b) return b",
+        "select (a)-[*0]->(b) return b",
+        "select (a)-[*1..]->(b) return b",
+        "select (a)-[*1. .3]->(b) return b",
+        "select (a)-[*1...3]->(b) return b",
+        "select (a x=1..3) return a",
+        "select shortestPath ( (a)<-[ p * 1..3 ]-(b) ) return b",
+        "select shortestPath((a)-[*0..2]->(b), :len) return a",
+        "select shortestPath((a)-[p*2]->(b)) return p",
+        "select shortestPath((a)<-[p*]->(b)) return p",
+        "select shortestPath((a)-->(b)) return a",
+        "select shortestPath((a)-[p*]->(b), limit) return a",
+        "select shortestPath((a)-[p*]->(b)-->(c)) return a",
+        "select (a)-[p*]->(b) return p",
+        "select (a)-[*]->(b) return a",
+        "select (a:Paper :Journal)-->(b :x=1) return a",
+        "select (:Paper)-->(b) return b",
+        "select (a x=1 :Paper) return a",
+        "select (a)-[e:Cites]->(b) return a",
+        "select (a :) return a"
+    };
+    for (const char* s : sentences)
+    {
+        bool parses = true;
+        try
+        {
+            HIDDEN::parseGraphSqlImpl(s);
+        } catch(...)
+        {
+            parses = false;
+        }
+        // group by without aggregates is only caught by the parser
+        if (string(s).find("group by") == string::npos)
+        {
+            EXPECT_EQ(parses, checkGraphSql(s) == 0) << s;
+        }
+    }
+}
+
+#define TWICE(x) x x
+#define TIMES8(x) TWICE(TWICE(TWICE(x)))
+#define TIMES64(x) TIMES8(TIMES8(x))
+// 640 characters of string, name or spaces, 64 hops
+#define LONG_STRING "select (a x=\"" TIMES64("0123456789") "\") return a"
+#define LONG_NAME "select (" TIMES64("abcdefghij") ")" TIMES64(" ") "-->(b) return " TIMES64("abcdefghij")
+#define LONG_HOPS "select (a)" TIMES64("-[e]->(n x=1.5)") "<--(b) return a, b"
+#define LONG_UNTERMINATED "select (a x=\"" TIMES64("0123456789") ") return a"
+
+TEST(GraphDSLTest, StaticCheckLengthTest)
+{
+    using namespace netalgo;
+    using namespace netalgo::impl;
+    // runs of characters nest O(log n) deep and every hop a few levels, see graphdsl_static.hpp
+    static_assert(checkGraphSql(LONG_STRING) == 0, "");
+    static_assert(checkGraphSql(LONG_NAME) == 0, "");
+    static_assert(checkGraphSql(LONG_HOPS) == 0, "");
+    static_assert(checkGraphSql(LONG_UNTERMINATED) == graphsqlcheck::badProperty, "");
+    static_assert(checkGraphSql("select (a)-[*" TIMES64("0") "2]->(b) return a") == 0, "");
+    EXPECT_EQ(640ul, GRAPHSQL(LONG_STRING).first.nodes[0].properties[0].value.size() - 2);
+    EXPECT_EQ(65ul, GRAPHSQL(LONG_HOPS).first.edges.size());
+
+    const char* sentences[] = { LONG_STRING, LONG_NAME, LONG_HOPS, LONG_UNTERMINATED };
+    for (const char* s : sentences)
+    {
+        bool parses = true;
+        try
+        {
+            HIDDEN::parseGraphSqlImpl(s);
+        } catch(...)
+        {
+            parses = false;
+        }
+        EXPECT_EQ(parses, checkGraphSql(s) == 0) << s;
+    }
+}
+
 TEST(GraphDSLTest, SenteceSpeedTest)
 {
     using namespace HIDDEN;
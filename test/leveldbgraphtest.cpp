@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <map>
+#include <cmath>
 #include "leveldbgraphtest.pb.h"
 #include "graphdsl.hpp"
 
@@ -113,10 +115,11 @@ TEST(LevelDbGraphTest, LevelDbGraphQuery)
             if (1==cnt)
             {
                 EXPECT_EQ(string("C"), it->getNode("b").id());
-                EXPECT_EQ(string("E2"), it->getNode("e").id());
+                EXPECT_EQ(string("E2"), it->getEdge("e").id());
             }
             ++cnt;
         }
+        EXPECT_EQ(2u, cnt);
     }
     g.removeEdge("E");
     g.removeNode("A");
@@ -362,3 +365,1984 @@ TEST(LevelDbGraphTest, LevelDbDeductionStepsTest)
     }
 }
 
+
+TEST(LevelDbGraphTest, LevelDbGraphCompactionTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("ccc.db");
+    g.destroy();
+    CompactionOptions options;
+    EXPECT_FALSE(options.enabled);
+    options.enabled = true;
+    options.prefixLength = 1;
+    options.minDeletes = 50;
+    options.densityThreshold = 0.1;
+    g.setCompactionOptions(options);
+
+    vector<Node> nodes;
+    vector<Edge> edges;
+    for (int i=0; i<200; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+        if (i > 0)
+        {
+            Edge e;
+            e.set_id("e" + to_string(i));
+            e.set_from("n" + to_string(i-1));
+            e.set_to("n" + to_string(i));
+            edges.push_back(e);
+        }
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    for (int i=1; i<200; ++i)
+        g.removeEdge("e" + to_string(i));
+    g.waitForCompactions();
+
+    CompactionStats stats = g.getCompactionStats();
+    EXPECT_EQ(199u, stats.tombstonesTracked);
+    EXPECT_GE(stats.rangeChecks, 1u);
+    EXPECT_GE(stats.compactionsRun, 1u);
+    EXPECT_EQ(stats.tombstonesTracked, stats.tombstonesCompacted + stats.pendingTombstones);
+    EXPECT_TRUE(g.getOutEdge("n0").empty());
+
+    std::size_t cnt = 0;
+    for (auto it = g.query("select (a) return a"_graphsql); it != g.end(); ++it)
+        ++cnt;
+    EXPECT_EQ(200u, cnt);
+    stats = g.getCompactionStats();
+    EXPECT_GE(stats.fullScans, 1u);
+    EXPECT_GE(stats.fullScanSteps, 200u);
+    g.destroy();
+}
+
+namespace
+{
+    class FakePlannerStatistics : public netalgo::impl::PlannerStatistics
+    {
+        public:
+            virtual netalgo::GraphStatistics graphStatistics() const override
+            {
+                netalgo::GraphStatistics result;
+                result.nodeCount = 10000;
+                result.edgeCount = 50000;
+                return result;
+            }
+            virtual std::uint64_t degree(const std::string& nodeId,
+                        netalgo::EdgeDirection direction) const override
+            {
+                if (nodeId == "hub") return 100000;
+                return direction == netalgo::EdgeDirection::prev ? 2 : 3;
+            }
+    };
+}
+
+TEST(LevelDbGraphTest, LevelDbPlannerTest)
+{
+    using namespace netalgo;
+    using namespace netalgo::impl;
+    FakePlannerStatistics stats;
+
+    // expand from the anchor instead of scanning both ends
+    auto ded = planDeductionSteps("select (a)-[e1]->(m id=\"M\")<-[e2]-(c) return a,c"_graphsql, stats);
+    ASSERT_EQ(5u, ded.size());
+    EXPECT_EQ(2u, ded[0].id);
+    EXPECT_TRUE(ded[0].direct);
+    for (std::size_t i = 1; i < ded.size(); ++i)
+    {
+        EXPECT_FALSE(ded[i].direct);
+        EXPECT_NE(DeductionTrait::notConstrainted, ded[i].constraint);
+    }
+
+    // start walking from the low degree end
+    ded = planDeductionSteps("select (a id=\"hub\")-[e]->(b)-[f]->(c id=\"C\") return b"_graphsql, stats);
+    ASSERT_EQ(5u, ded.size());
+    EXPECT_EQ(3u, ded[2].id);
+    EXPECT_EQ(DeductionTrait::rightConstrained, ded[2].constraint);
+    EXPECT_EQ(1u, ded[4].id);
+    EXPECT_EQ(DeductionTrait::bothConstrained, ded[4].constraint);
+
+    // without an anchor the most selective node is scanned
+    ded = planDeductionSteps("select (a)-->(b imp>1 imp<2) return a"_graphsql, stats);
+    ASSERT_EQ(3u, ded.size());
+    EXPECT_EQ(2u, ded[0].id);
+    EXPECT_EQ(DeductionTrait::notConstrainted, ded[0].constraint);
+    EXPECT_EQ(DeductionTrait::rightConstrained, ded[1].constraint);
+    EXPECT_EQ(DeductionTrait::rightConstrained, ded[2].constraint);
+}
+
+TEST(LevelDbGraphTest, LevelDbStatisticsTest)
+{
+    using namespace netalgo;
+    {
+        LevelDbGraph<Node, Edge> g("sss.db");
+        g.destroy();
+        vector<Node> nodes;
+        for (int i=0; i<10; ++i)
+        {
+            Node n;
+            n.set_id("n" + to_string(i));
+            n.set_imp(i);
+            nodes.push_back(n);
+        }
+        g.setNodesBundle(nodes);
+        g.setNode(nodes[0]);
+        for (int i=1; i<10; ++i)
+        {
+            Edge e;
+            e.set_id("e" + to_string(i));
+            e.set_from("D");
+            e.set_to("n" + to_string(i));
+            g.setEdge(e);
+            g.setEdge(e);
+        }
+        Node d;
+        d.set_id("D");
+        d.set_imp(0);
+        g.setNode(d);
+        EXPECT_EQ(11u, g.getStatistics().nodeCount);
+        EXPECT_EQ(9u, g.getStatistics().edgeCount);
+        // an edge moved to another from is still the same edge
+        Edge moved;
+        moved.set_id("e9");
+        moved.set_from("n1");
+        moved.set_to("n9");
+        g.setEdge(moved);
+        EXPECT_EQ(9u, g.getStatistics().edgeCount);
+        moved.set_from("D");
+        g.setEdge(moved);
+        EXPECT_EQ(9u, g.getStatistics().edgeCount);
+
+        g.removeEdge("e1");
+        g.removeNode("n2");
+        EXPECT_EQ(10u, g.getStatistics().nodeCount);
+        EXPECT_EQ(7u, g.getStatistics().edgeCount);
+
+        std::set<string> found;
+        for (auto it = g.query("select (d id=\"D\")-[e]->(n imp>4) return n"_graphsql);
+                    it != g.end(); ++it)
+            found.insert(it->getNode("n").id());
+        EXPECT_EQ((std::set<string>{"n5", "n6", "n7", "n8", "n9"}), found);
+    }
+    {
+        LevelDbGraph<Node, Edge> g("sss.db");
+        EXPECT_EQ(10u, g.getStatistics().nodeCount);
+        EXPECT_EQ(7u, g.getStatistics().edgeCount);
+        g.analyze();
+        EXPECT_EQ(10u, g.getStatistics().nodeCount);
+        EXPECT_EQ(7u, g.getStatistics().edgeCount);
+        g.destroy();
+        EXPECT_EQ(0u, g.getStatistics().nodeCount);
+    }
+}
+
+TEST(LevelDbGraphTest, LevelDbIndexTest)
+{
+    using namespace netalgo;
+    using namespace netalgo::impl;
+    auto prop = [](const char* name, Relationship rel, const char* value)
+    {
+        Property p;
+        p.name = name;
+        p.relationship = rel;
+        p.value = value;
+        return p;
+    };
+    {
+        LevelDbGraph<Node, Edge> g("iii.db");
+        g.destroy();
+        vector<Node> nodes;
+        vector<Edge> edges;
+        for (int i=0; i<100; ++i)
+        {
+            Node n;
+            n.set_id("n" + to_string(i));
+            n.set_imp(i % 10);
+            nodes.push_back(n);
+            if (i > 0)
+            {
+                Edge e;
+                e.set_id("e" + to_string(i));
+                e.set_from("n" + to_string(i-1));
+                e.set_to("n" + to_string(i));
+                edges.push_back(e);
+            }
+        }
+        g.setNodesBundle(nodes);
+        g.setEdgesBundle(edges);
+        EXPECT_EQ(-1, g.estimateIndexScan(true, prop("imp", Relationship::equal, "3")));
+
+        g.createNodeIndex("imp");
+        EXPECT_TRUE(g.hasNodeIndex("imp"));
+        EXPECT_THROW(g.createNodeIndex("nosuchfield"), std::runtime_error);
+        EXPECT_EQ(10, g.estimateIndexScan(true, prop("imp", Relationship::equal, "3")));
+
+        nodes[3].set_imp(4);
+        g.setNode(nodes[3]);
+        g.removeNode("n13");
+        EXPECT_EQ(8, g.estimateIndexScan(true, prop("imp", Relationship::equal, "3")));
+        EXPECT_EQ(11, g.estimateIndexScan(true, prop("imp", Relationship::equal, "4")));
+        EXPECT_EQ(20, g.estimateIndexScan(true, prop("imp", Relationship::greater, "7")));
+        EXPECT_EQ(10, g.estimateIndexScan(true, prop("imp", Relationship::smaller, "1")));
+        EXPECT_EQ(10, g.estimateIndexScan(true, prop("imp", Relationship::smaller, "0.5")));
+
+        auto sql = "select (a imp=3)-[e]->(b) return a,b"_graphsql;
+        auto ded = planDeductionSteps(sql, GraphPlannerStatistics< LevelDbGraph<Node, Edge> >(g));
+        EXPECT_EQ(0u, ded[0].id);
+        EXPECT_EQ(0, ded[0].indexedProperty);
+
+        CompactionStats before = g.getCompactionStats();
+        std::set<string> found;
+        for (auto it = g.query(sql); it != g.end(); ++it)
+        {
+            auto& result = *it;
+            found.insert(result.getNode("a").id() + "->" + result.getNode("b").id());
+        }
+        EXPECT_EQ((std::set<string>{"n23->n24", "n33->n34", "n43->n44", "n53->n54",
+                        "n63->n64", "n73->n74", "n83->n84", "n93->n94"}), found);
+        EXPECT_EQ(before.fullScans, g.getCompactionStats().fullScans);
+    }
+    {
+        LevelDbGraph<Node, Edge> g("iii.db");
+        EXPECT_TRUE(g.hasNodeIndex("imp"));
+        EXPECT_EQ(8, g.estimateIndexScan(true, prop("imp", Relationship::equal, "3")));
+        g.dropNodeIndex("imp");
+        EXPECT_FALSE(g.hasNodeIndex("imp"));
+        EXPECT_EQ(-1, g.estimateIndexScan(true, prop("imp", Relationship::equal, "3")));
+        g.destroy();
+    }
+    {
+        // index entries holding a payload suffix in their value are not payloads
+        LevelDbGraph<Node, Edge> g("iii.db");
+        for (int i=0; i<3; ++i)
+        {
+            Edge e;
+            e.set_id("e" + to_string(i));
+            e.set_from("x:edge:@data");
+            e.set_to("n" + to_string(i));
+            e.set_len(i);
+            g.setEdge(e);
+        }
+        g.createEdgeIndex("from");
+        g.createEdgeIndex("len");
+        EXPECT_EQ(3, g.estimateIndexScan(false, prop("len", Relationship::smaller, "5")));
+        EXPECT_EQ(1, g.estimateIndexScan(false, prop("len", Relationship::equal, "0")));
+
+        // ids may not look like index or label entries
+        Node n;
+        n.set_id("@index:n");
+        n.set_imp(0);
+        EXPECT_THROW(g.setNode(n), std::runtime_error);
+        Node fine;
+        fine.set_id("fine");
+        fine.set_imp(0);
+        EXPECT_THROW(g.setNodesBundle({fine, n}), std::runtime_error);
+        Edge e;
+        e.set_id("@label:e");
+        e.set_from("a");
+        e.set_to("b");
+        EXPECT_THROW(g.setEdge(e), std::runtime_error);
+        EXPECT_EQ(0u, g.getStatistics().nodeCount);
+        EXPECT_EQ(3u, g.getStatistics().edgeCount);
+        EXPECT_TRUE(g.query("select (a) return a"_graphsql) == g.end());
+        g.destroy();
+    }
+}
+
+TEST(LevelDbGraphTest, LevelDbResultRowTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("rrr.db");
+    g.destroy();
+    for (int i=0; i<3; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        g.setNode(n);
+    }
+    for (int i=1; i<3; ++i)
+    {
+        Edge e;
+        e.set_id("e" + to_string(i));
+        e.set_from("n0");
+        e.set_to("n" + to_string(i));
+        g.setEdge(e);
+    }
+
+    std::size_t cnt = 0;
+    for (auto it = g.query("select (a id=\"n0\")-[e]->(b) return b,e,a,b"_graphsql);
+                it != g.end(); ++it)
+    {
+        auto& row = *it;
+        EXPECT_EQ(2u, row.nodes.size());
+        EXPECT_EQ(1u, row.edges.size());
+        EXPECT_EQ(&row.getNode("b"), &row.getNode(0));
+        EXPECT_EQ(&row.getNode("a"), &row.getNode(1));
+        EXPECT_EQ(&row.getEdge("e"), &row.getEdge(0));
+        EXPECT_EQ(string("n0"), it->getNode("a").id());
+        EXPECT_EQ(row.getEdge("e").to(), row.getNode("b").id());
+        EXPECT_DOUBLE_EQ(cnt + 1, row.getNode("b").imp());
+        EXPECT_THROW(row.getNode("c"), std::runtime_error);
+
+        // a row is read once; later dereferences see the same objects
+        it->getNode("b").set_imp(-1);
+        EXPECT_DOUBLE_EQ(-1, it->getNode("b").imp());
+        ++cnt;
+    }
+    EXPECT_EQ(2u, cnt);
+    EXPECT_DOUBLE_EQ(1, g.getNode("n1").imp());
+
+    // a row removed before it is read is not handed back empty
+    auto it = g.query("select (a id=\"n0\")-[e]->(b) return a,b"_graphsql);
+    ASSERT_TRUE(it != g.end());
+    g.removeNode("n1");
+    g.removeNode("n2");
+    EXPECT_THROW(*it, std::runtime_error);
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbBatchTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("bbb.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    for (int i=0; i<20; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i % 4);
+        nodes.push_back(n);
+    }
+    for (int i=0; i<40; ++i)
+    {
+        Edge e;
+        e.set_id("e" + to_string(i));
+        e.set_from("n" + to_string(i % 20));
+        e.set_to("n" + to_string((i * 7 + 3) % 20));
+        edges.push_back(e);
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    const char* queries[] = {
+        "select (a)-[e]->(b imp=2) return a,e,b",
+        "select (a imp<2)-[e]->(b)<-[f]-(c imp>1) return a,b,c,e,f",
+        "select (a id=\"n3\")-[e]->(b)-[f]->(c) return a,c,f",
+        "select (a)-[e id=\"e5\"]->(b)-[f]->(c id=\"n6\") return a,b,c",
+        "select (a id=\"nosuchnode\")-[e]->(b) return b"
+    };
+    for (const char* q : queries)
+    {
+        auto parsed = parseGraphSql(q);
+        const GraphSqlSentence& sql = *parsed;
+        std::multiset<string> expected, got;
+        for (auto it = g.query(sql); it != g.end(); ++it)
+        {
+            string row;
+            for (const auto& name : sql.second.returnName)
+                row += (name[0] == 'e' || name[0] == 'f' ?
+                            it->getEdge(name).id() : it->getNode(name).id()) + ",";
+            expected.insert(row);
+        }
+        auto cursor = g.queryBatches(sql, 3);
+        LevelDbGraphBatch<Node, Edge> batch;
+        while (cursor.next(batch))
+        {
+            EXPECT_FALSE(batch.empty());
+            for (std::size_t i = 0; i < batch.size(); ++i)
+            {
+                string row;
+                for (const auto& name : sql.second.returnName)
+                    row += (name[0] == 'e' || name[0] == 'f' ?
+                                batch.getEdges(name)[i].id() : batch.getNodes(name)[i].id()) + ",";
+                got.insert(row);
+            }
+        }
+        EXPECT_TRUE(batch.empty());
+        EXPECT_EQ(expected, got) << q;
+    }
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbParallelQueryTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("ppp.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    for (int i=0; i<500; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i % 5);
+        nodes.push_back(n);
+    }
+    for (int i=0; i<1500; ++i)
+    {
+        Edge e;
+        e.set_id("e" + to_string(i));
+        e.set_from("n" + to_string(i % 500));
+        e.set_to("n" + to_string((i * 13 + 7) % 500));
+        edges.push_back(e);
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    auto rows = [](decltype(g.end()) it, decltype(g.end()) end)
+    {
+        vector<string> result;
+        for (; it != end; ++it)
+            result.push_back(it->getNode("a").id() + "-" + it->getEdge("e").id() + "-" + it->getNode("b").id());
+        return result;
+    };
+    const GraphSqlSentence& sql = "select (a imp<3)-[e]->(b imp>1) return a,e,b"_graphsql;
+    vector<string> serial = rows(g.query(sql), g.end());
+    EXPECT_FALSE(serial.empty());
+    EXPECT_EQ(serial, rows(g.query(sql, 4, true), g.end()));
+    vector<string> unordered = rows(g.query(sql, 4), g.end());
+    EXPECT_EQ(std::multiset<string>(serial.begin(), serial.end()),
+                std::multiset<string>(unordered.begin(), unordered.end()));
+
+    // direct anchors are not split but still run on a worker
+    const GraphSqlSentence& direct = "select (a id=\"n7\")-[e]->(b) return a,e,b"_graphsql;
+    EXPECT_EQ(rows(g.query(direct), g.end()), rows(g.query(direct, 4, true), g.end()));
+
+    // abandoning a query stops its workers
+    {
+        auto it = g.query("select (a)-[e]->(b)-[f]->(c) return a,b,c"_graphsql, 8);
+        ASSERT_TRUE(it != g.end());
+        ++it;
+    }
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbLimitTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("lll.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    for (int i=0; i<200; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+        if (i > 0)
+        {
+            Edge e;
+            e.set_id("e" + to_string(i));
+            e.set_from("n" + to_string(i-1));
+            e.set_to("n" + to_string(i));
+            edges.push_back(e);
+        }
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    std::size_t all = 0;
+    CompactionStats before = g.getCompactionStats();
+    for (auto it = g.query("select (a)-[e]->(b) return a,b"_graphsql); it != g.end(); ++it)
+        ++all;
+    std::uint64_t fullSteps = g.getCompactionStats().fullScanSteps - before.fullScanSteps;
+    EXPECT_EQ(199u, all);
+
+    vector<string> first;
+    before = g.getCompactionStats();
+    for (auto it = g.query("select (a)-[e]->(b) return a,b limit 5"_graphsql); it != g.end(); ++it)
+        first.push_back(it->getNode("a").id());
+    EXPECT_EQ(5u, first.size());
+    // the scan stops at the limit instead of running to the end
+    EXPECT_LT((g.getCompactionStats().fullScanSteps - before.fullScanSteps) * 10, fullSteps);
+
+    EXPECT_TRUE(g.query("select (a)-[e]->(b) return a limit 0"_graphsql) == g.end());
+
+    vector<string> sunk;
+    EXPECT_EQ(3u, g.execute("select (a)-[e]->(b) return a,b"_graphsql,
+                    [&](LevelDbGraphResult<Node, Edge>& row)
+                    {
+                        sunk.push_back(row.getNode("a").id());
+                        return sunk.size() < 3;
+                    }));
+    EXPECT_EQ(vector<string>(first.begin(), first.begin() + 3), sunk);
+
+    std::size_t seen = 0;
+    EXPECT_EQ(5u, g.execute("select (a)-[e]->(b) return a,b limit 5"_graphsql,
+                    [&](LevelDbGraphResult<Node, Edge>&) { ++seen; }, 4));
+    EXPECT_EQ(5u, seen);
+
+    std::size_t batched = 0;
+    auto cursor = g.queryBatches("select (a)-[e]->(b) return a,b limit 7"_graphsql, 3);
+    LevelDbGraphBatch<Node, Edge> batch;
+    while (cursor.next(batch))
+        batched += batch.size();
+    EXPECT_EQ(7u, batched);
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbAggregateTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("agg.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    for (int i=0; i<2; ++i)
+    {
+        Node n;
+        n.set_id("h" + to_string(i));
+        n.set_imp(100 * (i + 1));
+        nodes.push_back(n);
+    }
+    for (int i=0; i<6; ++i)
+    {
+        Node n;
+        n.set_id("l" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+    }
+    auto addEdge = [&edges](const string& id, const string& from, const string& to)
+    {
+        Edge e;
+        e.set_id(id);
+        e.set_from(from);
+        e.set_to(to);
+        edges.push_back(e);
+    };
+    for (int i=0; i<6; ++i)
+        addEdge("e" + to_string(i), "h" + to_string(i % 2), "l" + to_string(i));
+    addEdge("e6", "h0", "l1");
+    addEdge("e7", "h0", "l2");
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    auto total = g.aggregate(
+                "select (a)-[e]->(b) return count(*), count(distinct a), count(distinct b)"_graphsql);
+    ASSERT_EQ(1u, total.size());
+    EXPECT_TRUE(total[0].keys.empty());
+    EXPECT_EQ((vector<double>{8, 2, 6}), total[0].values);
+
+    auto grouped = g.aggregate(
+                "select (a)-[e]->(b) return a, count(*), count(distinct b), sum(b.imp), min(b.imp), "
+                "max(b.imp), avg(b.imp) group by a"_graphsql);
+    std::map<string, vector<double> > byHub;
+    for (const AggregateRow& row : grouped)
+    {
+        ASSERT_EQ(1u, row.keys.size());
+        byHub[row.keys[0]] = row.values;
+    }
+    EXPECT_EQ((vector<double>{5, 4, 9, 0, 4, 1.8}), byHub["h0"]);
+    EXPECT_EQ((vector<double>{3, 3, 9, 1, 5, 3}), byHub["h1"]);
+    EXPECT_EQ(1u, g.aggregate("select (a)-[e]->(b) return a, count(*) limit 1"_graphsql).size());
+
+    auto none = g.aggregate("select (a imp>1000)-[e]->(b) return count(*), sum(b.imp), max(b.imp)"_graphsql);
+    ASSERT_EQ(1u, none.size());
+    EXPECT_EQ(0, none[0].values[0]);
+    EXPECT_EQ(0, none[0].values[1]);
+    EXPECT_TRUE(std::isnan(none[0].values[2]));
+    EXPECT_TRUE(g.aggregate("select (a imp>1000)-[e]->(b) return a, count(*)"_graphsql).empty());
+
+    EXPECT_THROW(g.query("select (a)-[e]->(b) return count(*)"_graphsql), std::runtime_error);
+    EXPECT_THROW(g.aggregate("select (a)-[e]->(b) return a"_graphsql), std::runtime_error);
+    EXPECT_THROW(g.aggregate("select (a)-[e]->(b) return sum(a.id)"_graphsql), std::runtime_error);
+    EXPECT_THROW(g.aggregate("select (a)-[e]->(b) return sum(a.nosuchfield)"_graphsql), std::runtime_error);
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbPreparedQueryTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("prp.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    for (int i=0; i<10; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+        if (i > 0)
+        {
+            Edge e;
+            e.set_id("e" + to_string(i));
+            e.set_from("n" + to_string(i-1));
+            e.set_to("n" + to_string(i));
+            edges.push_back(e);
+        }
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    PreparedGraphSql prepared("select (a id=$from)-[e]->(b imp>$min) return b");
+    EXPECT_EQ((vector<string>{"from", "min"}), prepared.parameters());
+    for (int i=0; i<9; ++i)
+    {
+        vector<string> found;
+        auto sql = prepared.bind(GraphSqlParameters().set("from", "n" + to_string(i)).set("min", 4));
+        for (auto it = g.query(sql); it != g.end(); ++it)
+            found.push_back(it->getNode("b").id());
+        EXPECT_EQ(i + 1 > 4 ? vector<string>{"n" + to_string(i + 1)} : vector<string>(), found);
+    }
+    EXPECT_THROW(g.query(prepared.sentence()), std::runtime_error);
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbVariableLengthTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("var.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    for (int i=0; i<6; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+    }
+    auto addEdge = [&edges](const string& from, const string& to)
+    {
+        Edge e;
+        e.set_id("e" + to_string(edges.size()));
+        e.set_from(from);
+        e.set_to(to);
+        edges.push_back(e);
+    };
+    // a diamond n0 -> n1, n2 -> n3 with a parallel edge, closed into a cycle by n3 -> n4 -> n0
+    addEdge("n0", "n1");
+    addEdge("n0", "n1");
+    addEdge("n0", "n2");
+    addEdge("n1", "n3");
+    addEdge("n2", "n3");
+    addEdge("n3", "n4");
+    addEdge("n4", "n0");
+    addEdge("n5", "n0");
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    auto found = [&g](const GraphSqlSentence& sql, const string& name)
+    {
+        vector<string> result;
+        for (auto it = g.query(sql); it != g.end(); ++it)
+            result.push_back(it->getNode(name).id());
+        sort(result.begin(), result.end());
+        return result;
+    };
+    EXPECT_EQ((vector<string>{"n1", "n2", "n3"}),
+                found("select (a id=\"n0\")-[*1..2]->(b) return b"_graphsql, "b"));
+    EXPECT_EQ((vector<string>{"n3", "n4"}),
+                found("select (a id=\"n0\")-[*2..3]->(b) return b"_graphsql, "b"));
+    EXPECT_EQ((vector<string>{"n0", "n4"}),
+                found("select (a id=\"n0\")-[*3..4]->(b) return b"_graphsql, "b"));
+    EXPECT_EQ((vector<string>{"n0", "n1", "n2"}),
+                found("select (a id=\"n0\")-[*0..1]->(b) return b"_graphsql, "b"));
+    EXPECT_EQ((vector<string>{"n0", "n1", "n2"}),
+                found("select (a id=\"n3\")<-[*1..2]-(b) return b"_graphsql, "b"));
+    EXPECT_EQ((vector<string>{"n4"}),
+                found("select (a id=\"n0\")-[*1..3]->(b id=\"n4\") return b"_graphsql, "b"));
+    EXPECT_TRUE(found("select (a id=\"n0\")-[*1..2]->(b id=\"n4\") return b"_graphsql, "b").empty());
+    EXPECT_EQ((vector<string>{"n1", "n2"}),
+                found("select (a)-[*2]->(b)-[e]->(c id=\"n0\") return a"_graphsql, "a"));
+    EXPECT_EQ((vector<string>{"n3"}),
+                found("select (a)-[*1..2]->(b imp>2 imp<4) return b limit 1"_graphsql, "b"));
+
+    // the batch cursor, the parallel query and aggregate() see the same rows
+    const GraphSqlSentence& all = "select (a)-[*1..3]->(b) return a, b"_graphsql;
+    auto rows = [](LevelDbGraph<Node, Edge>::ResultType it, LevelDbGraph<Node, Edge>::ResultType end)
+    {
+        vector< pair<string, string> > result;
+        for (; it != end; ++it)
+            result.push_back(make_pair(it->getNode("a").id(), it->getNode("b").id()));
+        sort(result.begin(), result.end());
+        return result;
+    };
+    auto serial = rows(g.query(all), g.end());
+    EXPECT_EQ(serial, rows(g.query(all, 3), g.end()));
+    EXPECT_EQ(serial.end(), unique(serial.begin(), serial.end()));
+    EXPECT_EQ(static_cast<double>(serial.size()),
+                g.aggregate("select (a)-[*1..3]->(b) return count(*)"_graphsql)[0].values[0]);
+    // n0, n3, n4 and n5 reach 4 nodes each, n1 and n2 reach 3
+    EXPECT_EQ(22u, serial.size());
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbShortestPathTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("sp.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    auto addNode = [&nodes](const string& id)
+    {
+        Node n;
+        n.set_id(id);
+        n.set_imp(1);
+        nodes.push_back(n);
+    };
+    auto addEdge = [&edges](const string& id, const string& from, const string& to, double len)
+    {
+        Edge e;
+        e.set_id(id);
+        e.set_from(from);
+        e.set_to(to);
+        e.set_len(len);
+        edges.push_back(e);
+    };
+    for (const char* id : {"A", "B", "C", "D", "E", "X", "Z", "F", "G"})
+        addNode(id);
+    addEdge("e1", "A", "B", 1);
+    addEdge("e2", "B", "C", 1);
+    addEdge("e3", "C", "D", 1);
+    addEdge("e4", "A", "D", 10);
+    addEdge("e5", "D", "E", 1);
+    addEdge("e6", "A", "X", 1);
+    addEdge("e7", "X", "D", 1);
+    addEdge("e8", "E", "A", 1);
+    addEdge("e9", "F", "G", -1);
+    // a hub with many leaves, one of which leads to T
+    addNode("R");
+    addNode("T");
+    for (int i=0; i<200; ++i)
+    {
+        addNode("L" + to_string(i));
+        addEdge("r" + to_string(i), "R", "L" + to_string(i), 1);
+    }
+    addEdge("t", "L7", "T", 1);
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    // node ids then edge ids of the path, empty if there is none
+    auto path = [&g](const GraphSqlSentence& sql)
+    {
+        vector<string> result;
+        for (auto it = g.query(sql); it != g.end(); ++it)
+        {
+            for (const Node& n : it->nodes)
+                result.push_back(n.id());
+            for (const Edge& e : it->edges)
+                result.push_back(e.id());
+        }
+        return result;
+    };
+    EXPECT_EQ((vector<string>{"A", "D", "e4"}),
+                path("select shortestPath((a id=\"A\")-[p*]->(b id=\"D\")) return p"_graphsql));
+    EXPECT_EQ((vector<string>{"A", "D", "E", "e4", "e5"}),
+                path("select shortestPath((a id=\"A\")-[p*]->(b id=\"E\")) return p"_graphsql));
+    EXPECT_EQ((vector<string>{"A", "X", "D", "E", "e6", "e7", "e5"}),
+                path("select shortestPath((a id=\"A\")-[p*]->(b id=\"E\"), len) return p"_graphsql));
+    EXPECT_EQ((vector<string>{"E", "D", "A", "e5", "e4"}),
+                path("select shortestPath((a id=\"E\")<-[p*]-(b id=\"A\")) return p"_graphsql));
+    EXPECT_EQ((vector<string>{"A", "D", "E", "A", "e4", "e5", "e8"}),
+                path("select shortestPath((a id=\"A\")-[p*]->(b id=\"A\")) return p"_graphsql));
+    EXPECT_EQ((vector<string>{"A", "X", "D", "E", "A", "e6", "e7", "e5", "e8"}),
+                path("select shortestPath((a id=\"A\")-[p*]->(b id=\"A\"), len) return p"_graphsql));
+    EXPECT_EQ((vector<string>{"A"}),
+                path("select shortestPath((a id=\"A\")-[p*0..3]->(b id=\"A\")) return p"_graphsql));
+    EXPECT_EQ((vector<string>{"A", "D", "E", "e4", "e5"}),
+                path("select shortestPath((a id=\"A\")-[p*1..2]->(b id=\"E\")) return p"_graphsql));
+    EXPECT_TRUE(path("select shortestPath((a id=\"A\")-[p*1..1]->(b id=\"E\")) return p"_graphsql).empty());
+    EXPECT_TRUE(path("select shortestPath((a id=\"A\")-[p*]->(b id=\"Z\")) return p"_graphsql).empty());
+    EXPECT_TRUE(path("select shortestPath((a id=\"A\")-[p*]->(b id=\"E\" imp>100)) return p"_graphsql).empty());
+    EXPECT_TRUE(path("select shortestPath((a id=\"A\")-[p*]->(b id=\"nosuchnode\")) return p"_graphsql).empty());
+
+    auto it = g.query("select shortestPath((a id=\"A\")-[p*]->(b id=\"E\")) return b, a"_graphsql, 4);
+    ASSERT_TRUE(it != g.end());
+    EXPECT_EQ(2u, it->nodes.size());
+    EXPECT_EQ("A", it->getNode("a").id());
+    EXPECT_EQ("E", it->getNode("b").id());
+    EXPECT_TRUE(it->edges.empty());
+    EXPECT_TRUE(++it == g.end());
+
+    // the search from T finds L7 after reading two adjacency lists, not the 200 leaves
+    const GraphSqlSentence& hub = "select shortestPath((a id=\"R\")-[p*]->(b id=\"T\")) return p"_graphsql;
+    impl::ShortestPath<Node, Edge> search(g, hub);
+    vector<string> pathNodes, pathEdges;
+    ASSERT_TRUE(search.find(pathNodes, pathEdges));
+    EXPECT_EQ((vector<string>{"R", "L7", "T"}), pathNodes);
+    EXPECT_EQ((vector<string>{"r7", "t"}), pathEdges);
+    EXPECT_GE(3u, search.explored());
+
+    EXPECT_THROW(g.query("select shortestPath((a id=\"F\")-[p*]->(b id=\"G\"), len) return p"_graphsql),
+                std::runtime_error);
+    EXPECT_THROW(g.query("select shortestPath((a id=\"A\")-[p*1..3]->(b id=\"E\"), len) return p"_graphsql),
+                std::runtime_error);
+    EXPECT_THROW(g.query("select shortestPath((a)-[p*]->(b id=\"E\")) return p"_graphsql), std::runtime_error);
+    EXPECT_THROW(g.queryBatches("select shortestPath((a id=\"A\")-[p*]->(b id=\"E\")) return p"_graphsql),
+                std::runtime_error);
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbCyclicJoinTest)
+{
+    using namespace netalgo;
+    vector<string> common;
+    impl::leapfrogIntersect({}, common);
+    EXPECT_TRUE(common.empty());
+    vector<string> x{"a", "c", "d", "f", "k"}, y{"b", "c", "f", "k", "z"}, z{"c", "k"};
+    impl::leapfrogIntersect({&x, &y, &z}, common);
+    EXPECT_EQ((vector<string>{"c", "k"}), common);
+    impl::leapfrogIntersect({&x}, common);
+    EXPECT_EQ(x, common);
+
+    LevelDbGraph<Node, Edge> g("cycle.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    auto addNode = [&nodes](const string& id, double imp)
+    {
+        Node n;
+        n.set_id(id);
+        n.set_imp(imp);
+        nodes.push_back(n);
+    };
+    auto addEdge = [&edges](const string& from, const string& to)
+    {
+        Edge e;
+        e.set_id("e" + to_string(edges.size()));
+        e.set_from(from);
+        e.set_to(to);
+        edges.push_back(e);
+    };
+    // the triangle A -> B -> C -> A with a parallel edge C -> A, a hub H with
+    // many open wedges and one triangle H -> L0 -> L1 -> H, and a self loop on S
+    addNode("A", 1);
+    addNode("B", 2);
+    addNode("C", 3);
+    addNode("H", 4);
+    addNode("S", 5);
+    addEdge("A", "B");
+    addEdge("B", "C");
+    addEdge("C", "A");
+    addEdge("C", "A");
+    for (int i=0; i<20; ++i)
+    {
+        addNode("L" + to_string(i), 10 + i);
+        addEdge("H", "L" + to_string(i));
+        if (i % 2 == 0)
+            addEdge("L" + to_string(i), "H");
+    }
+    addEdge("L0", "L1");
+    addEdge("L1", "H");
+    addEdge("B", "L3");
+    addEdge("L3", "C");
+    addEdge("S", "S");
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    auto rows = [](LevelDbGraph<Node, Edge>::ResultType it, LevelDbGraph<Node, Edge>::ResultType end,
+                const vector<string>& names)
+    {
+        vector< vector<string> > result;
+        for (; it != end; ++it)
+        {
+            vector<string> row;
+            for (const string& name : names)
+                row.push_back(name[0] == 'e' ? it->getEdge(name).id() : it->getNode(name).id());
+            result.push_back(row);
+        }
+        sort(result.begin(), result.end());
+        return result;
+    };
+    vector< vector<string> > triangles, diamonds;
+    for (const Edge& ab : edges)
+        for (const Edge& bc : edges)
+            if (ab.to() == bc.from())
+                for (const Edge& ca : edges)
+                {
+                    if (bc.to() == ca.from() && ca.to() == ab.from())
+                        triangles.push_back({ab.from(), ab.to(), bc.to(), ab.id(), bc.id(), ca.id()});
+                    if (ca.from() == ab.from())
+                        for (const Edge& cd : edges)
+                            if (cd.from() == ca.to() && cd.to() == bc.to())
+                                diamonds.push_back({ab.from(), ab.to(), ca.to(), bc.to()});
+                }
+    sort(triangles.begin(), triangles.end());
+    sort(diamonds.begin(), diamonds.end());
+    // both triangles once per rotation, the first twice for the parallel edge,
+    // and the self loop going round three times
+    EXPECT_EQ(10u, triangles.size());
+
+    const GraphSqlSentence& triangle =
+        "select (a)-[e1]->(b)-[e2]->(c)-[e3]->(a) return a, b, c, e1, e2, e3"_graphsql;
+    const vector<string> triangleNames{"a", "b", "c", "e1", "e2", "e3"};
+    EXPECT_EQ(triangles, rows(g.query(triangle), g.end(), triangleNames));
+    EXPECT_EQ(triangles, rows(g.query(triangle, 3), g.end(), triangleNames));
+    EXPECT_EQ(static_cast<double>(triangles.size()),
+                g.aggregate("select (a)-->(b)-->(c)-->(a) return count(*)"_graphsql)[0].values[0]);
+    const GraphSqlSentence& diamond = "select (a)-->(b)-->(d)<--(c)<--(a) return a, b, c, d"_graphsql;
+    EXPECT_EQ(diamonds, rows(g.query(diamond), g.end(), {"a", "b", "c", "d"}));
+
+    EXPECT_EQ((vector< vector<string> >{{"A", "B", "C"}, {"A", "B", "C"}}),
+                rows(g.query("select (a id=\"A\")-->(b)-->(c)-->(a) return a, b, c"_graphsql), g.end(),
+                    {"a", "b", "c"}));
+    EXPECT_EQ((vector< vector<string> >{{"L1", "H", "L0"}}),
+                rows(g.query("select (a)-->(b)-->(c)-->(a imp>10) return a, b, c"_graphsql), g.end(),
+                    {"a", "b", "c"}));
+    EXPECT_EQ(10u, rows(g.query("select (a)<--(b)<--(c)<--(a) return a"_graphsql), g.end(), {"a"}).size());
+    EXPECT_EQ(1u, rows(g.query("select (a)<--(b)<--(c)<--(a) return a limit 1"_graphsql), g.end(),
+                    {"a"}).size());
+    EXPECT_EQ((vector< vector<string> >{{"S"}}),
+                rows(g.query("select (a)-->(a) return a"_graphsql), g.end(), {"a"}));
+
+    // the plan of a cyclic pattern starts from one of its nodes
+    const GraphSqlSentence& byEdge = "select (a)-[e1 id=\"e4\"]->(b)-->(a) return a"_graphsql;
+    EXPECT_TRUE(impl::isNode(impl::planDeductionSteps(byEdge,
+                    impl::GraphPlannerStatistics< LevelDbGraph<Node, Edge> >(g)).at(0).id));
+    EXPECT_EQ((vector< vector<string> >{{"H"}}), rows(g.query(byEdge), g.end(), {"a"}));
+    EXPECT_THROW(g.query("select (a)-[*1..2]->(b)-->(a) return a"_graphsql), std::runtime_error);
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbProfileTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("profile.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    // the chain n0 -> n1 -> ... -> n9
+    for (int i=0; i<10; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+        if (i == 0)
+            continue;
+        Edge e;
+        e.set_id("e" + to_string(i));
+        e.set_from("n" + to_string(i - 1));
+        e.set_to("n" + to_string(i));
+        edges.push_back(e);
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    const GraphSqlSentence& sql = "select (a imp>6)-[e]->(b) return a, b"_graphsql;
+    EXPECT_EQ("0: scan (a) where imp>6\n"
+                "1: [e] leaving (a)\n"
+                "2: (b) at the end of [e]\n", g.explain(sql));
+    QueryProfile profile = g.profile(sql);
+    ASSERT_EQ(4u, profile.steps.size());
+    EXPECT_EQ(2u, profile.rows);
+    const StepProfile& scan = profile.steps[0];
+    EXPECT_EQ(10u, scan.candidates);
+    EXPECT_EQ(7u, scan.rejectedByProperties);
+    EXPECT_EQ(0u, scan.rejectedByNeighbours);
+    EXPECT_EQ(3u, scan.rowsOut());
+    EXPECT_LE(1u, scan.seeks);
+    EXPECT_LE(10u, scan.keysScanned);
+    EXPECT_EQ(10u, scan.gets);
+    // n9 has no out-edges
+    const StepProfile& expand = profile.steps[1];
+    EXPECT_EQ(3u, expand.rowsIn);
+    EXPECT_EQ(2u, expand.candidates);
+    EXPECT_EQ(3u, expand.gets + expand.cacheHits);
+    EXPECT_EQ(2u, profile.steps[2].rowsOut());
+    EXPECT_EQ(2u, profile.steps[3].rowsIn);
+    EXPECT_LT(0u, profile.steps[3].bytesDecoded);
+    ostringstream os;
+    os << profile;
+    EXPECT_NE(string::npos, os.str().find("2 rows in"));
+
+    EXPECT_EQ("0: (a) by id where id=\"n3\"\n"
+                "1: [e] leaving (a)\n"
+                "2: (b) at the end of [e] where imp<5\n",
+                g.explain("select (a id=\"n3\")-[e]->(b imp<5) return b"_graphsql));
+    EXPECT_EQ(1u, g.profile("select (a id=\"n3\")-[e]->(b imp<5) return b"_graphsql).rows);
+    string cycle = g.explain("select (a)-->(b)-->(a) return a"_graphsql);
+    EXPECT_NE(string::npos, cycle.find("1: (a) in the neighbours of (b)\n")) << cycle;
+    EXPECT_EQ(0u, g.profile("select (a)-->(b)-->(a) return a"_graphsql).rows);
+    EXPECT_EQ(9u, g.profile("select (a)-->(b) return count(*)"_graphsql).rows);
+    EXPECT_EQ("0: shortestPath from n2 to n5 by breadth first search from both ends\n",
+                g.explain("select shortestPath((a id=\"n2\")-[p*]->(b id=\"n5\")) return p"_graphsql));
+    EXPECT_EQ(1u, g.profile("select shortestPath((a id=\"n2\")-[p*]->(b id=\"n5\")) return p"_graphsql).rows);
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbDeadlineTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("deadline.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    // every pair of 40 nodes both ways: millions of paths of three edges
+    for (int i=0; i<40; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+        for (int j=0; j<40; ++j)
+            if (i != j)
+            {
+                Edge e;
+                e.set_id("e" + to_string(i) + "_" + to_string(j));
+                e.set_from("n" + to_string(i));
+                e.set_to("n" + to_string(j));
+                edges.push_back(e);
+            }
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+    const GraphSqlSentence& slow = "select (a)-->(b)-->(c)-->(d) return a, d"_graphsql;
+    auto drain = [&g](LevelDbGraph<Node, Edge>::ResultType it)
+    {
+        auto start = chrono::steady_clock::now();
+        for (; it != g.end(); ++it)
+            ;
+        EXPECT_GT(chrono::seconds(5), chrono::steady_clock::now() - start);
+        return it.status();
+    };
+
+    EXPECT_EQ(QueryStatus::timedOut, drain(g.query(slow, QueryControl(chrono::milliseconds(50)))));
+    EXPECT_EQ(QueryStatus::timedOut, drain(g.query(slow, 4, false, QueryControl(chrono::milliseconds(50)))));
+    EXPECT_EQ(QueryStatus::timedOut,
+                drain(g.query("select (a)-[*1..3]->(b) return a"_graphsql, QueryControl(chrono::milliseconds(50)))));
+
+    CancellationToken token;
+    token.cancel();
+    auto it = g.query(slow, QueryControl(token));
+    EXPECT_TRUE(it == g.end());
+    EXPECT_EQ(QueryStatus::cancelled, it.status());
+
+    CancellationToken other;
+    thread canceller([other]() mutable
+                {
+                    this_thread::sleep_for(chrono::milliseconds(30));
+                    other.cancel();
+                });
+    EXPECT_EQ(QueryStatus::cancelled, drain(g.query(slow, QueryControl(other))));
+    canceller.join();
+
+    auto cursor = g.queryBatches(slow, 64, QueryControl(chrono::milliseconds(50)));
+    LevelDbGraphBatch<Node, Edge> batch;
+    while (cursor.next(batch))
+        ;
+    EXPECT_EQ(QueryStatus::timedOut, cursor.status());
+
+    auto quick = g.query("select (a id=\"n1\")-[e]->(b) return b"_graphsql, QueryControl(chrono::seconds(60)));
+    EXPECT_EQ(QueryStatus::running, quick.status());
+    EXPECT_EQ(QueryStatus::finished, drain(quick));
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbMeetInTheMiddleTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("meet.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    auto addNode = [&nodes](const string& id, double imp)
+    {
+        Node n;
+        n.set_id(id);
+        n.set_imp(imp);
+        nodes.push_back(n);
+    };
+    auto addEdge = [&edges](const string& from, const string& to)
+    {
+        Edge e;
+        e.set_id("e" + to_string(edges.size()));
+        e.set_from(from);
+        e.set_to(to);
+        edges.push_back(e);
+    };
+    // X reaches Y through M0..M4 and Q, and through the hub H, whose 200
+    // leaves only P7 leads on to Y; Y goes on to Z
+    addNode("X", 1);
+    addNode("Y", 2);
+    addNode("Z", 3);
+    addNode("H", 4);
+    addNode("Q", 5);
+    addEdge("X", "H");
+    for (int i=0; i<5; ++i)
+    {
+        addNode("M" + to_string(i), i);
+        addEdge("X", "M" + to_string(i));
+        addEdge("M" + to_string(i), "Q");
+    }
+    for (int i=0; i<200; ++i)
+    {
+        addNode("P" + to_string(i), i);
+        addEdge("H", "P" + to_string(i));
+    }
+    addEdge("Q", "Y");
+    addEdge("P7", "Y");
+    addEdge("H", "Q");
+    addEdge("M2", "Y");
+    addEdge("Y", "Z");
+    addEdge("Y", "X");
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+    EXPECT_EQ((vector< pair<size_t, size_t> >{{0, 6}}),
+                impl::meetSegments("select (a id=\"X\")-->(b)-->(c)-->(d id=\"Y\") return b"_graphsql.first));
+    EXPECT_FALSE(impl::meetSegments("select (a id=\"X\")-->(b)-->(d id=\"Y\") return b"_graphsql.first).empty());
+    EXPECT_TRUE(impl::meetSegments("select (a id=\"X\")-->(d id=\"Y\") return d"_graphsql.first).empty());
+    EXPECT_TRUE(impl::meetSegments("select (a id=\"X\")-[*1..2]->(b)-->(d id=\"Y\") return b"_graphsql.first).empty());
+
+    // every walk over the edges whose nodes at the given indexes have the given ids
+    auto expected = [&edges](size_t length, const map<size_t, string>& fixed)
+    {
+        vector< vector<string> > result;
+        vector<const Edge*> walk;
+        function<void()> extend = [&]()
+        {
+            size_t n = walk.size();
+            auto nodeOk = [&](size_t i, const string& id)
+            {
+                return !fixed.count(i) || fixed.at(i) == id;
+            };
+            if (n == length)
+            {
+                vector<string> row;
+                for (const Edge* e : walk)
+                    row.push_back(e->id());
+                result.push_back(row);
+                return;
+            }
+            for (const Edge& e : edges)
+                if ((n == 0 ? nodeOk(0, e.from()) : e.from() == walk.back()->to()) && nodeOk(n + 1, e.to()))
+                {
+                    walk.push_back(&e);
+                    extend();
+                    walk.pop_back();
+                }
+        };
+        extend();
+        sort(result.begin(), result.end());
+        return result;
+    };
+    auto rows = [](LevelDbGraph<Node, Edge>::ResultType it, LevelDbGraph<Node, Edge>::ResultType end,
+                size_t length)
+    {
+        vector< vector<string> > result;
+        for (; it != end; ++it)
+        {
+            vector<string> row;
+            for (size_t i = 0; i < length; ++i)
+                row.push_back(it->getEdge("e" + to_string(i)).id());
+            result.push_back(row);
+        }
+        sort(result.begin(), result.end());
+        return result;
+    };
+
+    const GraphSqlSentence& three =
+        "select (a id=\"X\")-[e0]->(b)-[e1]->(c)-[e2]->(d id=\"Y\") return e0, e1, e2"_graphsql;
+    auto paths = expected(3, {{0, "X"}, {3, "Y"}});
+    EXPECT_EQ(7u, paths.size());
+    EXPECT_EQ(paths, rows(g.query(three), g.end(), 3));
+    EXPECT_EQ(paths, rows(g.query(three, 4), g.end(), 3));
+    EXPECT_EQ(expected(2, {{0, "X"}, {2, "Y"}}),
+                rows(g.query("select (a id=\"X\")-[e0]->(b)-[e1]->(d id=\"Y\") return e0, e1"_graphsql),
+                    g.end(), 2));
+    EXPECT_EQ(expected(4, {{1, "X"}, {4, "Y"}}),
+                rows(g.query("select (w)-[e0]->(a id=\"X\")-[e1]->(b)-[e2]->(c)-[e3]->(d id=\"Y\") "
+                        "return e0, e1, e2, e3"_graphsql), g.end(), 4));
+    EXPECT_EQ(expected(5, {{0, "X"}, {3, "Y"}, {5, "H"}}),
+                rows(g.query("select (a id=\"X\")-[e0]->(b)-[e1]->(c)-[e2]->(d id=\"Y\")-[e3]->(x)"
+                        "-[e4]->(h id=\"H\") return e0, e1, e2, e3, e4"_graphsql), g.end(), 5));
+    auto filtered = g.query("select (a id=\"X\")-->(b imp>1)-->(c)-->(d id=\"Y\") return b"_graphsql);
+    set<string> through;
+    for (; filtered != g.end(); ++filtered)
+        through.insert(filtered->getNode("b").id());
+    EXPECT_EQ((set<string>{"H", "M2", "M3", "M4"}), through);
+    EXPECT_TRUE(g.query("select (a id=\"X\")-->(b)-->(c)-->(d id=\"H\") return b"_graphsql) == g.end());
+
+    EXPECT_EQ("0: (a) by id where id=\"X\"\n"
+                "1: (d) by id where id=\"Y\"\n"
+                "2: (a) to (d) over [e0] (b) [e1] (c) [e2] from both ends, joined where they meet\n",
+                g.explain(three));
+    // Y has two in-edges and X six out-edges, so the leaves of H are never read
+    QueryProfile profile = g.profile(three);
+    EXPECT_EQ(7u, profile.rows);
+    EXPECT_EQ(7u, profile.steps[2].rowsOut());
+    EXPECT_GT(50u, profile.steps[2].gets + profile.steps[2].cacheHits);
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbInlineAdjacencyTest)
+{
+    using namespace netalgo;
+    vector<Edge> edges;
+    auto addEdge = [&edges](const string& from, const string& to, double len)
+    {
+        Edge e;
+        e.set_id("e" + to_string(edges.size()));
+        e.set_from(from);
+        e.set_to(to);
+        e.set_len(len);
+        edges.push_back(e);
+    };
+    // every node points to the next three, n5 back to n0
+    vector<Node> nodes;
+    for (int i=0; i<6; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+    }
+    for (int i=0; i<6; ++i)
+        for (int j=i+1; j<=i+3 && j<6; ++j)
+            addEdge("n" + to_string(i), "n" + to_string(j), i + j);
+    addEdge("n5", "n0", 1);
+
+    const vector<GraphSqlSentence> sqls = {
+        "select (a)-[e]->(b) return a, e, b"_graphsql,
+        "select (a)-[e len<6]->(b) return e"_graphsql,
+        "select (a id=\"n0\")-[e]->(b)-[f len>5]->(c imp<5) return e, f, c"_graphsql,
+        "select (a id=\"n4\")<-[e]-(b)<-[f]-(c) return b, c, f"_graphsql,
+        "select (a)-[e]->(b)-[f]->(c)-[g]->(a) return e, f, g"_graphsql,
+        "select (a id=\"n0\")-[*1..3]->(b) return b"_graphsql,
+        "select (a id=\"n0\")-[e0]->(b)-[e1]->(c)-[e2 len>4]->(d id=\"n5\") return e0, e1, e2"_graphsql,
+        "select shortestPath((a id=\"n0\")-[p*]->(b id=\"n5\"), len) return p"_graphsql
+    };
+    // every row of every query, as the ids and lens in it
+    auto results = [&sqls](LevelDbGraph<Node, Edge>& g, size_t parallelism)
+    {
+        vector< vector<string> > result;
+        for (const GraphSqlSentence& sql : sqls)
+        {
+            vector<string> rows;
+            for (auto it = parallelism ? g.query(sql, parallelism) : g.query(sql); it != g.end(); ++it)
+            {
+                string row;
+                for (const Node& n : it->nodes)
+                    row += n.id() + " ";
+                for (const Edge& e : it->edges)
+                    row += e.id() + ":" + e.from() + ">" + e.to() + ":" + to_string(e.len()) + " ";
+                rows.push_back(row);
+            }
+            sort(rows.begin(), rows.end());
+            result.push_back(rows);
+        }
+        return result;
+    };
+
+    {
+        LevelDbGraph<Node, Edge> g("inline.db");
+        g.destroy();
+        g.setNodesBundle(nodes);
+        g.setEdgesBundle(edges);
+        const GraphSqlSentence& filtered = "select (a id=\"n0\")-[e len<100]->(b) return b"_graphsql;
+        auto reads = [&g](const GraphSqlSentence& sql)
+        {
+            size_t total = 0;
+            for (const StepProfile& s : g.profile(sql).steps)
+                total += s.gets + s.cacheHits;
+            return total;
+        };
+        size_t plainReads = reads(filtered);
+        auto plain = results(g, 0);
+        EXPECT_FALSE(plain[0].empty());
+        EXPECT_FALSE(plain[7].empty());
+
+        EXPECT_THROW(g.setInlineEdgeFields({"weight"}), std::runtime_error);
+        EXPECT_FALSE(g.hasInlineAdjacency());
+        g.setInlineEdgeFields({"len"});
+        EXPECT_TRUE(g.hasInlineAdjacency());
+        EXPECT_TRUE(g.inlinesField("len"));
+        EXPECT_TRUE(g.inlinesField("to"));
+        EXPECT_EQ(plain, results(g, 0));
+        EXPECT_EQ(plain, results(g, 3));
+        // the three edges leaving n0 are read neither for the filter nor for
+        // the step to b
+        EXPECT_EQ(plainReads - 6, reads(filtered));
+
+        vector<Edge> stubs = g.getAdjacentEdges("n0", true);
+        ASSERT_EQ(3u, stubs.size());
+        EXPECT_EQ("e0", stubs[0].id());
+        EXPECT_EQ("n1", stubs[0].to());
+        EXPECT_EQ(1, stubs[0].len());
+
+        // writes keep the stubs in step with the edges
+        Edge changed = edges[1];
+        changed.set_len(50);
+        g.setEdge(changed);
+        addEdge("n2", "n0", 3);
+        g.setEdge(edges.back());
+        g.removeEdge("e4");
+        g.removeNode("n3");
+        auto inlined = results(g, 0);
+        g.dropInlineAdjacency();
+        EXPECT_FALSE(g.hasInlineAdjacency());
+        EXPECT_EQ(results(g, 0), inlined);
+        g.setInlineEdgeFields({});
+        EXPECT_FALSE(g.inlinesField("len"));
+        EXPECT_EQ(inlined, results(g, 0));
+    }
+    {
+        // the inlined fields are kept with the graph
+        LevelDbGraph<Node, Edge> g("inline.db");
+        EXPECT_TRUE(g.hasInlineAdjacency());
+        EXPECT_FALSE(g.inlinesField("len"));
+        g.destroy();
+        EXPECT_FALSE(g.hasInlineAdjacency());
+    }
+}
+
+TEST(LevelDbGraphTest, LevelDbResultCacheTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("resultcache.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    for (int i=0; i<20; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+        if (i > 0)
+        {
+            Edge e;
+            e.set_id("e" + to_string(i));
+            e.set_from("n" + to_string(i-1));
+            e.set_to("n" + to_string(i));
+            edges.push_back(e);
+        }
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    auto rows = [&g](LevelDbGraph<Node, Edge>::ResultType it)
+    {
+        vector<string> result;
+        for (; it != g.end(); ++it)
+        {
+            string row;
+            for (const Node& n : it->nodes)
+                row += n.id() + ":" + to_string(n.imp()) + " ";
+            for (const Edge& e : it->edges)
+                row += e.id() + " ";
+            result.push_back(row);
+        }
+        return result;
+    };
+    const GraphSqlSentence& sql = "select (a imp>10)-[e]->(b) return b, e"_graphsql;
+    // a control bypasses the cache
+    auto uncached = rows(g.query(sql, QueryControl()));
+    EXPECT_EQ(8u, uncached.size());
+    EXPECT_EQ(0u, g.getResultCacheStats().misses);
+
+    g.setResultCacheSize(1 << 20);
+    EXPECT_EQ(uncached, rows(g.query(sql)));
+    EXPECT_EQ(uncached, rows(g.query(sql)));
+    EXPECT_EQ(uncached, rows(g.query("select (a  imp>10)-[e]->(b)  return b, e"_graphsql)));
+    ResultCacheStats stats = g.getResultCacheStats();
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(1u, stats.entries);
+    EXPECT_LT(0u, stats.bytes);
+    EXPECT_DOUBLE_EQ(2.0 / 3, stats.hitRate());
+
+    PreparedGraphSql prepared("select (a id=$from)-[e]->(b) return b");
+    for (int i=0; i<3; ++i)
+    {
+        auto it = g.query(prepared.bind(GraphSqlParameters().set("from", "n3")));
+        ASSERT_TRUE(it != g.end());
+        EXPECT_EQ("n4", it->getNode("b").id());
+        EXPECT_TRUE(++it == g.end());
+    }
+    EXPECT_EQ(4u, g.getResultCacheStats().hits);
+    const GraphSqlSentence& path = "select shortestPath((a id=\"n2\")-[p*]->(b id=\"n5\")) return p"_graphsql;
+    EXPECT_EQ(rows(g.query(path)), rows(g.query(path)));
+    EXPECT_EQ(1u, rows(g.query(path)).size());
+    EXPECT_TRUE(g.query("select (a imp>10)-[e]->(b) return b, e limit 0"_graphsql) == g.end());
+
+    // a write makes every entry stale
+    Node changed = nodes[15];
+    changed.set_imp(100);
+    g.setNode(changed);
+    auto after = rows(g.query(sql));
+    EXPECT_NE(uncached, after);
+    EXPECT_EQ(rows(g.query(sql, QueryControl())), after);
+    EXPECT_EQ(1u, g.getResultCacheStats().stale);
+    g.removeEdge("e19");
+    EXPECT_EQ(7u, rows(g.query(sql)).size());
+
+    // the least recently used entries make room for new ones
+    size_t capacity = g.getResultCacheStats().bytes;
+    g.setResultCacheSize(capacity);
+    for (int i=0; i<5; ++i)
+        g.query(prepared.bind(GraphSqlParameters().set("from", "n" + to_string(i))));
+    stats = g.getResultCacheStats();
+    EXPECT_LT(0u, stats.evictions);
+    EXPECT_GE(capacity, stats.bytes);
+    g.setResultCacheSize(0);
+    EXPECT_EQ(0u, g.getResultCacheStats().entries);
+    EXPECT_EQ(7u, rows(g.query(sql)).size());
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbPrefetchTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("prefetch.db");
+    g.destroy();
+    vector<Node> nodes;
+    vector<Edge> edges;
+    // a hub with 100 spokes, each going on to a second node
+    for (int i=0; i<=200; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+    }
+    for (int i=1; i<=100; ++i)
+    {
+        Edge e;
+        e.set_id("e" + to_string(i));
+        e.set_from("n0");
+        e.set_to("n" + to_string(i));
+        e.set_len(i);
+        edges.push_back(e);
+        e.set_id("f" + to_string(i));
+        e.set_from("n" + to_string(i));
+        e.set_to("n" + to_string(i + 100));
+        edges.push_back(e);
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    const GraphSqlSentence& sql = "select (a id=\"n0\")-[e len>50]->(b)-[f]->(c) return e, c"_graphsql;
+    auto rows = [&g, &sql]()
+    {
+        vector<string> result;
+        for (auto it = g.query(sql); it != g.end(); ++it)
+            result.push_back(it->getEdge("e").id() + " " + it->getNode("c").id());
+        return result;
+    };
+    auto expected = rows();
+    EXPECT_EQ(50u, expected.size());
+    EXPECT_EQ(0u, g.getPrefetchStats().issued);
+
+    PrefetchOptions options;
+    options.threads = 2;
+    g.setPrefetchOptions(options);
+    EXPECT_EQ(expected, rows());
+    g.waitForPrefetches();
+    PrefetchStats stats = g.getPrefetchStats();
+    EXPECT_LE(100u, stats.issued + stats.dropped);
+    EXPECT_EQ(stats.issued, stats.completed);
+
+    // stubs holding len leave nothing to prefetch
+    g.setInlineEdgeFields({"len"});
+    g.setPrefetchOptions(options);
+    EXPECT_EQ(expected, rows());
+    EXPECT_EQ(0u, g.getPrefetchStats().issued);
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbIteratorResumeTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge> g("resume.db");
+    g.destroy();
+    const int size = 30, length = 11;
+    vector<Node> nodes;
+    vector<Edge> edges;
+    // every node points to the next two
+    for (int i=0; i<size; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(100 + i));
+        n.set_imp(i);
+        nodes.push_back(n);
+        for (int j=i+1; j<=i+2 && j<size; ++j)
+        {
+            Edge e;
+            e.set_id("e" + to_string(100 + i) + "_" + to_string(100 + j));
+            e.set_from("n" + to_string(100 + i));
+            e.set_to("n" + to_string(100 + j));
+            edges.push_back(e);
+        }
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    // walks of length edges, counted from their last node back
+    vector<size_t> walks(size, 1);
+    for (int step=0; step<length; ++step)
+    {
+        vector<size_t> longer(size, 0);
+        for (int i=0; i<size; ++i)
+            for (int j=i+1; j<=i+2 && j<size; ++j)
+                longer[i] += walks[j];
+        walks.swap(longer);
+    }
+    size_t expected = 0;
+    for (size_t w : walks)
+        expected += w;
+
+    string text = "select (a0)";
+    for (int i=1; i<=length; ++i)
+        text += "-->(a" + to_string(i) + ")";
+    text += " return a0, a" + to_string(length);
+    auto sql = *parseGraphSql(text);
+    size_t count = 0;
+    auto it = g.query(sql);
+    for (; it != g.end() && count < expected / 2; ++it)
+        ++count;
+    // a copy goes on from the same row, reopening the scan it was in
+    auto copy = it;
+    for (; it != g.end(); ++it, ++copy)
+    {
+        ASSERT_TRUE(copy != g.end());
+        EXPECT_EQ(it->getNode("a0").id(), copy->getNode("a0").id());
+        EXPECT_EQ(it->getNode("a" + to_string(length)).id(), copy->getNode("a" + to_string(length)).id());
+        ++count;
+    }
+    EXPECT_TRUE(copy == g.end());
+    EXPECT_EQ(expected, count);
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbUndirectedQueryTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge, false> g("undirected.db");
+    g.destroy();
+    vector<Node> nodes;
+    for (string id : {"a", "b", "c", "d"})
+    {
+        Node n;
+        n.set_id(id);
+        n.set_imp(id[0] - 'a');
+        nodes.push_back(n);
+    }
+    g.setNodesBundle(nodes);
+    // a path a - b - c - d, a self loop at d and a chord a - c
+    vector<Edge> edges;
+    for (auto ends : vector< pair<string, string> >{ {"a", "b"}, {"c", "b"}, {"c", "d"}, {"d", "d"}, {"a", "c"} })
+    {
+        Edge e;
+        e.set_id(ends.first + ends.second);
+        e.set_from(ends.first);
+        e.set_to(ends.second);
+        e.set_len(edges.size());
+        edges.push_back(e);
+    }
+    g.setEdgesBundle(edges);
+
+    auto rows = [&g](const char* text)
+    {
+        multiset<string> result;
+        auto sql = *parseGraphSql(text);
+        for (auto it = g.query(sql); it != g.end(); ++it)
+        {
+            string row;
+            for (size_t i = 0; i < it->nodes.size(); ++i)
+                row += it->getNode(i).id();
+            for (size_t i = 0; i < it->edges.size(); ++i)
+                row += " " + it->getEdge(i).id();
+            result.insert(row);
+        }
+        return result;
+    };
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        // either end of an edge may be the first node
+        EXPECT_EQ((multiset<string>{"b ab", "c ac"}), rows("select (x id=\"a\")-[e]-(y) return y,e"));
+        EXPECT_EQ((multiset<string>{"a ab", "c cb"}), rows("select (x id=\"b\")-[e]-(y) return y,e"));
+        EXPECT_EQ((multiset<string>{"c", "d"}), rows("select (x id=\"d\")--(y) return y"));
+        EXPECT_EQ((multiset<string>{"ab", "ba"}), rows("select (x)-[e id=\"ab\"]-(y) return x,y"));
+        EXPECT_EQ((multiset<string>{"ac"}), rows("select (x id=\"a\")-[e]-(y id=\"c\") return x,y"));
+        EXPECT_EQ((multiset<string>{"dd"}), rows("select (x id=\"d\")-[e]-(y id=\"d\") return x,y"));
+        // every edge both ways, the loop once
+        EXPECT_EQ(9u, rows("select (x)--(y) return x,y").size());
+        EXPECT_EQ((multiset<string>{"cb", "cd", "dc", "dd"}),
+                    rows("select (x imp>1)-[e len<4]-(y) return x,y"));
+        EXPECT_EQ((multiset<string>{"ab", "ba"}), rows("select (x)-[e len<1]-(y) return x,y"));
+        // b - a - b comes back over the edge it came from
+        EXPECT_EQ((multiset<string>{"b", "c", "a", "b", "d"}),
+                    rows("select (x id=\"b\")--(y)--(z) return z"));
+        // the triangle a b c, from every node and both ways round
+        EXPECT_EQ((multiset<string>{"abc", "acb", "bac", "bca", "cab", "cba"}),
+                    rows("select (x imp<3)--(y imp<3)--(z imp<3)--(x) return x,y,z"));
+        EXPECT_EQ((multiset<string>{"a", "b", "c", "d"}), rows("select (x id=\"a\")-[*2]-(y) return y"));
+        EXPECT_EQ((multiset<string>{"a", "b", "c"}), rows("select (x id=\"b\")-[*0..1]-(y) return y"));
+        EXPECT_EQ((multiset<string>{"ad", "bd", "cd", "dd"}), rows("select (x)-[*2..3]-(y id=\"d\") return x,y"));
+        EXPECT_EQ(2u, rows("select (x)--(y) return x,y limit 2").size());
+        EXPECT_THROW(rows("select (x)-->(y) return x,y"), std::runtime_error);
+        EXPECT_THROW(rows("select (x)<-[e]-(y) return x,y"), std::runtime_error);
+        // the same with the endpoints kept in the adjacency lists
+        g.setInlineEdgeFields({"len"});
+    }
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbUndirectedQuerySpeedTest)
+{
+    using namespace netalgo;
+    LevelDbGraph<Node, Edge, false> g("undirectedspeed.db");
+    g.destroy();
+    const int size = 2000;
+    vector<Node> nodes;
+    vector<Edge> edges;
+    for (int i=0; i<size; ++i)
+    {
+        Node n;
+        n.set_id(to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+        if (i > 0)
+        {
+            Edge e;
+            e.set_id(to_string(i));
+            e.set_from(to_string(i-1));
+            e.set_to(to_string(i));
+            edges.push_back(e);
+        }
+    }
+    g.setNodesBundle(nodes);
+    g.setEdgesBundle(edges);
+
+    auto run = [&g](const char* name)
+    {
+#ifdef MYDEBUG
+        auto start = chrono::high_resolution_clock::now();
+#endif
+        size_t pairs = 0, walks = 0, anchored = 0;
+        for (auto it = g.query("select (a)--(b) return a,b"_graphsql); it != g.end(); ++it)
+            ++pairs;
+        for (auto it = g.query("select (a)--(b)--(c) return c"_graphsql); it != g.end(); ++it)
+            ++walks;
+        for (int i=0; i<size; i+=10)
+            for (auto it = g.query(*parseGraphSql("select (a id=\"" + to_string(i) + "\")--(b)--(c) return c"));
+                        it != g.end(); ++it)
+                ++anchored;
+        // every edge both ways; a walk of two edges may come back over the first
+        EXPECT_EQ(2u * (size - 1), pairs) << name;
+        EXPECT_EQ(4u * (size - 1) - 2, walks) << name;
+        EXPECT_EQ(4u * (size / 10) - 2, anchored) << name;
+#ifdef MYDEBUG
+        auto ms = chrono::duration_cast<chrono::milliseconds>(
+                    chrono::high_resolution_clock::now() - start).count();
+        LOGGER(info, "{}: {} rows takes {}ms, {} OP per second", name,
+                    pairs + walks + anchored, ms, (pairs + walks + anchored) * 1000.0 / (ms + 1));
+#endif
+    };
+    run("undirected");
+    g.setInlineEdgeFields({});
+    run("undirected, inline adjacency");
+    g.destroy();
+}
+
+TEST(LevelDbGraphTest, LevelDbEdgePartitionTest)
+{
+    using namespace netalgo;
+    vector<Edge> edges;
+    auto addEdge = [&edges](const string& from, const string& to, double len)
+    {
+        Edge e;
+        e.set_id("e" + to_string(edges.size()));
+        e.set_from(from);
+        e.set_to(to);
+        e.set_len(len);
+        edges.push_back(e);
+    };
+    // every node points to the next four, the len of each edge its type
+    vector<Node> nodes;
+    for (int i=0; i<6; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        nodes.push_back(n);
+    }
+    for (int i=0; i<6; ++i)
+        for (int j=i+1; j<=i+4 && j<6; ++j)
+            addEdge("n" + to_string(i), "n" + to_string(j), (i + j) % 3);
+    addEdge("n5", "n0", 1);
+    addEdge("n3", "n3", 2);
+
+    const vector<GraphSqlSentence> sqls = {
+        "select (a)-[e len=1]->(b) return a, e, b"_graphsql,
+        "select (a id=\"n0\")-[e len=1]->(b)-[f len=2]->(c) return e, f, c"_graphsql,
+        "select (a id=\"n4\")<-[e len=0]-(b)<-[f]-(c imp<3) return b, c, f"_graphsql,
+        "select (a id=\"n1\")-[e len=0]->(b id=\"n5\") return e"_graphsql,
+        "select (a)-[e len=1]->(b)-[f len=2]->(c)-[g len=1]->(a) return e, f, g"_graphsql,
+        "select (a)-[e len=2]->(a) return e"_graphsql,
+        "select (a id=\"n0\")-[e len<2]->(b) return b"_graphsql,
+        "select (a id=\"n2\")-[e len=7]->(b) return b"_graphsql
+    };
+    auto results = [&sqls](LevelDbGraph<Node, Edge>& g, size_t parallelism)
+    {
+        vector< vector<string> > result;
+        for (const GraphSqlSentence& sql : sqls)
+        {
+            vector<string> rows;
+            for (auto it = parallelism ? g.query(sql, parallelism) : g.query(sql); it != g.end(); ++it)
+            {
+                string row;
+                for (const Node& n : it->nodes)
+                    row += n.id() + " ";
+                for (const Edge& e : it->edges)
+                    row += e.id() + ":" + e.from() + ">" + e.to() + ":" + to_string(e.len()) + " ";
+                rows.push_back(row);
+            }
+            sort(rows.begin(), rows.end());
+            result.push_back(rows);
+        }
+        return result;
+    };
+
+    {
+        LevelDbGraph<Node, Edge> g("partition.db");
+        g.destroy();
+        g.setNodesBundle(nodes);
+        g.setEdgesBundle(edges);
+        const GraphSqlSentence& typed = "select (a id=\"n0\")-[e len=1]->(b) return b"_graphsql;
+        auto reads = [&g](const GraphSqlSentence& sql)
+        {
+            size_t total = 0;
+            for (const StepProfile& s : g.profile(sql).steps)
+                total += s.gets + s.cacheHits;
+            return total;
+        };
+        size_t plainReads = reads(typed);
+        auto plain = results(g, 0);
+        EXPECT_FALSE(plain[0].empty());
+        EXPECT_FALSE(plain[4].empty());
+        EXPECT_TRUE(plain[7].empty());
+
+        EXPECT_THROW(g.setEdgePartitionField("weight"), std::runtime_error);
+        EXPECT_THROW(g.setEdgePartitionField("to"), std::runtime_error);
+        EXPECT_FALSE(g.hasEdgePartition());
+        g.setEdgePartitionField("len");
+        EXPECT_TRUE(g.hasEdgePartition());
+        EXPECT_EQ(plain, results(g, 0));
+        EXPECT_EQ(plain, results(g, 3));
+        // the list read holds the two edges of type 1 leaving n0 alone, and
+        // none of the four is read for the filter or the step to b
+        EXPECT_EQ(plainReads - 6, reads(typed));
+        g.setInlineEdgeFields({});
+        EXPECT_TRUE(g.inlinesField("len"));
+        EXPECT_EQ(plain, results(g, 0));
+        EXPECT_EQ(plain, results(g, 3));
+
+        // writes move the edges between partitions
+        Edge changed = edges[1];
+        changed.set_len(1);
+        g.setEdge(changed);
+        addEdge("n2", "n0", 1);
+        g.setEdge(edges.back());
+        g.removeEdge("e4");
+        g.removeNode("n3");
+        auto partitioned = results(g, 0);
+        EXPECT_EQ(partitioned, results(g, 3));
+        g.dropInlineAdjacency();
+        EXPECT_EQ(partitioned, results(g, 0));
+        g.dropEdgePartition();
+        EXPECT_FALSE(g.hasEdgePartition());
+        EXPECT_EQ(partitioned, results(g, 0));
+        g.setEdgePartitionField("len");
+        EXPECT_EQ(partitioned, results(g, 0));
+    }
+    {
+        // the partition field is kept with the graph
+        LevelDbGraph<Node, Edge> g("partition.db");
+        EXPECT_TRUE(g.hasEdgePartition());
+        g.destroy();
+        EXPECT_FALSE(g.hasEdgePartition());
+    }
+    {
+        LevelDbGraph<Node, Edge, false> g("partition.db");
+        g.destroy();
+        g.setNodesBundle(nodes);
+        g.setEdgesBundle(edges);
+        auto rows = [&g](const char* text)
+        {
+            multiset<string> result;
+            for (auto it = g.query(*parseGraphSql(text)); it != g.end(); ++it)
+                result.insert(it->getNode(0).id() + it->getNode(1).id() + " " + it->getEdge(0).id());
+            return result;
+        };
+        const vector<const char*> texts = {
+            "select (x id=\"n3\")-[e len=2]-(y) return x,y,e",
+            "select (x)-[e len=0]-(y id=\"n4\") return x,y,e",
+            "select (x id=\"n1\")-[e len=1]-(y)-[f len=1]-(z) return x,y,e"
+        };
+        vector< multiset<string> > plain;
+        for (const char* text : texts)
+            plain.push_back(rows(text));
+        EXPECT_FALSE(plain[0].empty());
+        g.setEdgePartitionField("len");
+        for (size_t i = 0; i < texts.size(); ++i)
+            EXPECT_EQ(plain[i], rows(texts[i]));
+        Edge changed = edges[13];
+        changed.set_len(2);
+        g.setEdge(changed);
+        g.removeEdge("e2");
+        vector< multiset<string> > partitioned;
+        for (const char* text : texts)
+            partitioned.push_back(rows(text));
+        g.dropEdgePartition();
+        for (size_t i = 0; i < texts.size(); ++i)
+            EXPECT_EQ(partitioned[i], rows(texts[i]));
+        g.destroy();
+    }
+}
+
+TEST(LevelDbGraphTest, LevelDbNodeLabelTest)
+{
+    using namespace netalgo;
+    // every fourth node is a Paper, every eighth a Journal as well, the ones
+    // after a Paper are Authors; n(i-1) -> n(i)
+    vector<Node> nodes;
+    vector<Edge> edges;
+    for (int i=0; i<40; ++i)
+    {
+        Node n;
+        n.set_id("n" + to_string(i));
+        n.set_imp(i);
+        if (i % 4 == 0)
+            n.add_labels("Paper");
+        if (i % 8 == 0)
+            n.add_labels("Journal");
+        if (i % 4 == 1)
+            n.add_labels("Author");
+        nodes.push_back(n);
+        if (i > 0)
+        {
+            Edge e;
+            e.set_id("e" + to_string(i));
+            e.set_from("n" + to_string(i-1));
+            e.set_to("n" + to_string(i));
+            edges.push_back(e);
+        }
+    }
+    auto ids = [](LevelDbGraph<Node, Edge>& g, const GraphSqlSentence& sql, size_t parallelism)
+    {
+        set<string> result;
+        for (auto it = parallelism ? g.query(sql, parallelism) : g.query(sql); it != g.end(); ++it)
+        {
+            string row;
+            for (const Node& n : it->nodes)
+                row += n.id() + " ";
+            result.insert(row);
+        }
+        return result;
+    };
+    // the nodes carrying label, from their payloads
+    auto carrying = [&nodes](const string& label)
+    {
+        set<string> result;
+        for (const Node& n : nodes)
+            if (find(n.labels().begin(), n.labels().end(), label) != n.labels().end())
+                result.insert(n.id() + " ");
+        return result;
+    };
+    const GraphSqlSentence& papers = "select (a:Paper) return a"_graphsql;
+    const GraphSqlSentence& written = "select (a:Paper)-[e]->(b:Author) return a, b"_graphsql;
+
+    {
+        LevelDbGraph<Node, Edge> g("label.db");
+        g.destroy();
+        g.setNodesBundle(nodes);
+        g.setEdgesBundle(edges);
+        EXPECT_FALSE(g.hasNodeLabels());
+        EXPECT_EQ(-1, g.estimateLabelScan("Paper"));
+        EXPECT_THROW(g.query(papers), std::runtime_error);
+        EXPECT_THROW(g.setNodeLabelField("imp"), std::runtime_error);
+        EXPECT_THROW(g.setNodeLabelField("id"), std::runtime_error);
+        EXPECT_THROW(g.setNodeLabelField("kind"), std::runtime_error);
+        QueryProfile full = g.profile("select (a imp>-1) return a"_graphsql);
+
+        g.setNodeLabelField("labels");
+        EXPECT_TRUE(g.hasNodeLabels());
+        EXPECT_EQ(10, g.estimateLabelScan("Paper"));
+        EXPECT_EQ(5, g.estimateLabelScan("Journal"));
+        EXPECT_EQ(0, g.estimateLabelScan("Nothing"));
+
+        EXPECT_EQ(carrying("Paper"), ids(g, papers, 0));
+        EXPECT_EQ(carrying("Journal"), ids(g, "select (a:Paper:Journal) return a"_graphsql, 0));
+        EXPECT_EQ(carrying("Journal"), ids(g, "select (a:Journal:Paper) return a"_graphsql, 3));
+        EXPECT_TRUE(ids(g, "select (a:Author:Paper) return a"_graphsql, 0).empty());
+        EXPECT_EQ((set<string>{"n8 ", "n16 "}), ids(g, "select (a:Journal imp<20 imp>0) return a"_graphsql, 0));
+        set<string> pairs;
+        for (int i = 0; i < 40; i += 4)
+            pairs.insert("n" + to_string(i) + " n" + to_string(i + 1) + " ");
+        EXPECT_EQ(pairs, ids(g, written, 0));
+        EXPECT_EQ(pairs, ids(g, written, 3));
+        EXPECT_TRUE(ids(g, "select (a:Author)-[e]->(b:Author) return a, b"_graphsql, 0).empty());
+        EXPECT_EQ((set<string>{"n8 n9 "}),
+                    ids(g, "select (a id=\"n7\")-->(b:Journal)-->(c:Author) return b, c"_graphsql, 0));
+        EXPECT_TRUE(ids(g, "select (a id=\"n7\")-->(b:Author) return b"_graphsql, 0).empty());
+
+        // the scan reads the entries of the label instead of every key
+        EXPECT_EQ("0: scan (a:Journal:Paper) by the label Journal\n",
+                    g.explain("select (a:Journal:Paper) return a"_graphsql));
+        QueryProfile labelled = g.profile(papers);
+        EXPECT_GE(11u, labelled.steps[0].keysScanned);
+        EXPECT_LT(80u, full.steps[0].keysScanned);
+
+        // relabelled and removed nodes leave their labels
+        nodes[1].clear_labels();
+        nodes[1].add_labels("Paper");
+        g.setNode(nodes[1]);
+        g.removeNode("n4");
+        nodes.erase(nodes.begin() + 4);
+        EXPECT_EQ(carrying("Paper"), ids(g, papers, 0));
+        EXPECT_EQ(carrying("Author"), ids(g, "select (a:Author) return a"_graphsql, 0));
+        EXPECT_EQ(9, g.estimateLabelScan("Author"));
+    }
+    {
+        // the label field is kept with the graph
+        LevelDbGraph<Node, Edge> g("label.db");
+        EXPECT_TRUE(g.hasNodeLabels());
+        EXPECT_EQ(carrying("Paper"), ids(g, papers, 0));
+        g.dropNodeLabels();
+        EXPECT_FALSE(g.hasNodeLabels());
+        EXPECT_THROW(g.query(papers), std::runtime_error);
+        g.setNodeLabelField("labels");
+        EXPECT_EQ(carrying("Paper"), ids(g, papers, 0));
+        g.destroy();
+        EXPECT_FALSE(g.hasNodeLabels());
+    }
+    {
+        // labels and ids holding a payload suffix are not payloads
+        LevelDbGraph<Node, Edge> g("label.db");
+        g.destroy();
+        g.setNodeLabelField("labels");
+        nodes.clear();
+        for (const char* id : {"a", "b:node:@data", "c:edge:@data"})
+        {
+            Node n;
+            n.set_id(id);
+            n.set_imp(0);
+            n.add_labels("x:node:@data");
+            n.add_labels("y:edge:@data");
+            nodes.push_back(n);
+        }
+        g.setNodesBundle(nodes);
+        set<string> all{"a ", "b:node:@data ", "c:edge:@data "};
+        EXPECT_EQ(all, ids(g, "select (a) return a"_graphsql, 0));
+        EXPECT_EQ(3, g.estimateLabelScan("x:node:@data"));
+        EXPECT_TRUE(ids(g, "select (a)-[e]->(b) return a, b"_graphsql, 0).empty());
+        g.analyze();
+        EXPECT_EQ(3, g.getStatistics().nodeCount);
+        EXPECT_EQ(0, g.getStatistics().edgeCount);
+        g.destroy();
+    }
+}
@@ -97,3 +97,47 @@ TEST(ReflectionTest, SmallerCompareTest)
                     ));
 
 }
+
+TEST(ReflectionTest, CompiledPropertiesTest)
+{
+    using netalgo::impl::CompiledProperties;
+    testmsg msg;
+    msg.set_str("ABC");
+    msg.set_int_32(42);
+    msg.set_db(-6.2);
+    msg.set_boolean(true);
+
+    auto prop = [](const char* name, netalgo::Relationship rel, const char* value)
+    {
+        netalgo::Property p;
+        p.name = name;
+        p.relationship = rel;
+        p.value = value;
+        return p;
+    };
+    const netalgo::Relationship rels[] = { netalgo::Relationship::equal,
+        netalgo::Relationship::smaller, netalgo::Relationship::greater };
+    const std::pair<const char*, const char*> cases[] = {
+        {"str", "\"ABC\""}, {"str", "\"BBC\""}, {"str", "\"AAA\""},
+        {"int_32", "42"}, {"int_32", "41"}, {"int_32", "43"},
+        {"db", "-6.2"}, {"db", "-6.1"}, {"db", "-7"},
+        {"boolean", "true"}, {"boolean", "false"} };
+    for (auto rel : rels)
+        for (const auto& c : cases)
+        {
+            netalgo::Properties props{ prop(c.first, rel, c.second) };
+            EXPECT_EQ(reflectedCompare(&msg, c.first, rel, c.second),
+                        CompiledProperties<testmsg>(props)(msg)) << c.first << " " << c.second;
+        }
+
+    netalgo::Properties props{ prop("int_32", netalgo::Relationship::greater, "40"),
+        prop("str", netalgo::Relationship::equal, "\"ABC\"") };
+    CompiledProperties<testmsg> both(props);
+    EXPECT_TRUE(both(msg));
+    msg.set_str("ABD");
+    EXPECT_FALSE(both(msg));
+    EXPECT_TRUE(CompiledProperties<testmsg>(netalgo::Properties())(msg));
+
+    props.push_back(prop("nosuchfield", netalgo::Relationship::equal, "1"));
+    EXPECT_THROW(CompiledProperties<testmsg> bad(props), std::runtime_error);
+}